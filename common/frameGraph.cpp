@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <set>
+#include <frameGraph.hpp>
+
+void FrameGraph::clear() {
+    resources.clear();
+    passes.clear();
+    slotFormats.clear();
+}
+
+FrameGraph::Resource FrameGraph::addResource(std::string name, int transientFormat) {
+    ResourceNode resource = { name, transientFormat, false, -1, -1, -1 };
+    resources.push_back(resource);
+    return (Resource) resources.size() - 1;
+}
+
+void FrameGraph::addPass(std::string name, std::vector<Resource> reads, std::vector<Resource> writes, std::function<void()> execute) {
+    PassNode pass = { name, reads, writes, execute, false };
+    passes.push_back(pass);
+}
+
+void FrameGraph::addOutput(Resource resource) {
+    resources[resource].output = true;
+}
+
+void FrameGraph::compile() {
+
+    // Walk backwards from the outputs, a pass is kept if a later pass or the frame reads what it writes
+    std::set<Resource> needed;
+    for (Resource r = 0; r < (Resource) resources.size(); r++) {
+        if (resources[r].output) needed.insert(r);
+    }
+
+    for (int p = (int) passes.size() - 1; p >= 0; p--) {
+        PassNode &pass = passes[p];
+
+        pass.culled = true;
+        for (Resource r : pass.writes) {
+            if (needed.count(r) > 0) pass.culled = false;
+        }
+        if (pass.culled) continue;
+
+        // A write that does not also read the resource replaces it, so earlier writers are no longer needed
+        for (Resource r : pass.writes) {
+            if (std::find(pass.reads.begin(), pass.reads.end(), r) == pass.reads.end()) needed.erase(r);
+        }
+        for (Resource r : pass.reads) {
+            needed.insert(r);
+        }
+    }
+
+    int numPasses = (int) passes.size();
+
+    // Lifetimes span the first to the last kept pass touching a resource, outputs live to the end of the frame
+    for (int p = 0; p < numPasses; p++) {
+        if (passes[p].culled) continue;
+
+        std::vector<Resource> used = passes[p].reads;
+        used.insert(used.end(), passes[p].writes.begin(), passes[p].writes.end());
+
+        for (Resource r : used) {
+            if (resources[r].firstPass < 0) resources[r].firstPass = p;
+            resources[r].lastPass = p;
+        }
+    }
+
+    for (ResourceNode &resource : resources) {
+        if (resource.output && resource.firstPass >= 0) resource.lastPass = numPasses;
+    }
+
+    // Transients of the same format share a slot once the previous occupant is dead
+    std::vector<int> slotLastPass;
+    for (int p = 0; p < numPasses; p++) {
+        for (ResourceNode &resource : resources) {
+            if (resource.transientFormat == PERSISTENT || resource.firstPass != p) continue;
+
+            for (int s = 0; s < (int) slotFormats.size() && resource.slot < 0; s++) {
+                if (slotFormats[s] == resource.transientFormat && slotLastPass[s] < p) resource.slot = s;
+            }
+
+            if (resource.slot < 0) {
+                resource.slot = (int) slotFormats.size();
+                slotFormats.push_back(resource.transientFormat);
+                slotLastPass.push_back(-1);
+            }
+
+            slotLastPass[resource.slot] = resource.lastPass;
+        }
+    }
+}
+
+void FrameGraph::execute() {
+    for (PassNode &pass : passes) {
+        if (!pass.culled) pass.execute();
+    }
+}
+
+bool FrameGraph::isOutput(Resource resource) {
+    return resources[resource].output;
+}
+
+int FrameGraph::slotFor(Resource resource) {
+    return resources[resource].slot;
+}
+
+int FrameGraph::numSlots() {
+    return (int) slotFormats.size();
+}
+
+int FrameGraph::slotFormat(int slot) {
+    return slotFormats[slot];
+}
@@ -0,0 +1,59 @@
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Declares a frame's passes by the resources they read and write, culls passes whose results are
+// never consumed and packs transient resources with disjoint lifetimes into shared slots
+class FrameGraph {
+
+public:
+
+    typedef int Resource;
+
+    // Format of resources that live across frames, these are never aliased
+    static constexpr int PERSISTENT = -1;
+
+    // Building, the graph is rebuilt every frame
+    void clear();
+    Resource addResource(std::string name, int transientFormat = PERSISTENT);
+    void addPass(std::string name, std::vector<Resource> reads, std::vector<Resource> writes, std::function<void()> execute);
+    void addOutput(Resource resource);
+
+    // Culls passes and assigns transient resources to slots, passes run in the order they were added
+    void compile();
+    void execute();
+
+    // Compiled results
+    bool isOutput(Resource resource);
+    int slotFor(Resource resource);
+    int numSlots();
+    int slotFormat(int slot);
+
+private:
+
+    struct ResourceNode {
+        std::string name;
+        int transientFormat;
+        bool output;
+        int firstPass;
+        int lastPass;
+        int slot;
+    };
+    struct PassNode {
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        std::function<void()> execute;
+        bool culled;
+    };
+
+    std::vector<ResourceNode> resources;
+    std::vector<PassNode> passes;
+    std::vector<int> slotFormats;
+
+};
+
+#endif
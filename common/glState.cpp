@@ -0,0 +1,116 @@
+#include <glState.hpp>
+
+GLState::GLState() {
+    invalidate();
+}
+
+void GLState::invalidate() {
+    program = UNKNOWN;
+    framebuffer = UNKNOWN;
+    viewportWidth = -1;
+    viewportHeight = -1;
+    activeUnit = -1;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        textures[i] = UNKNOWN;
+        samplers[i] = UNKNOWN;
+    }
+    vertexArray = UNKNOWN;
+    blend = UNKNOWN;
+    blendSource = GL_NONE;
+    blendDestination = GL_NONE;
+    scissor = UNKNOWN;
+    for (int i = 0; i < 4; i++) {
+        scissorBox[i] = -1;
+    }
+}
+
+void GLState::useProgram(GLuint program) {
+    if (this->program == program) return;
+
+    glUseProgram(program);
+    this->program = program;
+}
+
+void GLState::bindFramebuffer(GLuint framebuffer) {
+    if (this->framebuffer == framebuffer) return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    this->framebuffer = framebuffer;
+}
+
+void GLState::viewport(int width, int height) {
+    if (viewportWidth == width && viewportHeight == height) return;
+
+    glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
+}
+
+void GLState::bindTexture(int unit, GLuint texture) {
+    // The unit is made active even when the texture is already bound, callers upload to it straight after
+    if (activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+
+    if (textures[unit] == texture) return;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    textures[unit] = texture;
+}
+
+void GLState::bindSampler(int unit, GLuint sampler) {
+    if (samplers[unit] == sampler) return;
+
+    glBindSampler(unit, sampler);
+    samplers[unit] = sampler;
+}
+
+void GLState::bindVertexArray(GLuint vertexArray) {
+    if (this->vertexArray == vertexArray) return;
+
+    glBindVertexArray(vertexArray);
+    this->vertexArray = vertexArray;
+}
+
+void GLState::enableBlend(GLenum source, GLenum destination) {
+    if (blend != GL_TRUE) {
+        glEnable(GL_BLEND);
+        blend = GL_TRUE;
+    }
+
+    if (blendSource != source || blendDestination != destination) {
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+    }
+}
+
+void GLState::disableBlend() {
+    if (blend == GL_FALSE) return;
+
+    glDisable(GL_BLEND);
+    blend = GL_FALSE;
+}
+
+void GLState::enableScissor(int x, int y, int width, int height) {
+    if (scissor != GL_TRUE) {
+        glEnable(GL_SCISSOR_TEST);
+        scissor = GL_TRUE;
+    }
+
+    if (scissorBox[0] != x || scissorBox[1] != y || scissorBox[2] != width || scissorBox[3] != height) {
+        glScissor(x, y, width, height);
+        scissorBox[0] = x;
+        scissorBox[1] = y;
+        scissorBox[2] = width;
+        scissorBox[3] = height;
+    }
+}
+
+void GLState::disableScissor() {
+    if (scissor == GL_FALSE) return;
+
+    glDisable(GL_SCISSOR_TEST);
+    scissor = GL_FALSE;
+}
@@ -0,0 +1,56 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <opengl.hpp>
+
+// Remembers the bound GL state so repeated binds and toggles can be skipped
+class GLState {
+
+public:
+
+    static constexpr int MAX_TEXTURE_UNITS = 8;
+
+    // Setup
+    GLState();
+
+    // Forget the cached state, e.g. after other code may have changed it
+    void invalidate();
+
+    // Binding
+    void useProgram(GLuint program);
+    void bindFramebuffer(GLuint framebuffer);
+    void viewport(int width, int height);
+    void bindTexture(int unit, GLuint texture);
+    void bindSampler(int unit, GLuint sampler);
+    void bindVertexArray(GLuint vertexArray);
+
+    // Blending
+    void enableBlend(GLenum source, GLenum destination);
+    void disableBlend();
+
+    // Scissoring
+    void enableScissor(int x, int y, int width, int height);
+    void disableScissor();
+
+private:
+
+    // Value of a slot whose state is not known
+    static constexpr GLuint UNKNOWN = ~0u;
+
+    GLuint program;
+    GLuint framebuffer;
+    int viewportWidth;
+    int viewportHeight;
+    int activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    GLuint samplers[MAX_TEXTURE_UNITS];
+    GLuint vertexArray;
+    GLuint blend;
+    GLenum blendSource;
+    GLenum blendDestination;
+    GLuint scissor;
+    int scissorBox[4];
+
+};
+
+#endif
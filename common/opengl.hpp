@@ -27,12 +27,16 @@ static inline void setColor(int shader, float color[]) {
     glUniform4fv(fillColorLocation, 1, color);
 }
 
-static inline void resetViewportToFramebuffer() {
-    if (window == NULL) return;
+static inline void getFramebufferSize(int* width, int* height) {
 
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    glViewport(0, 0, width, height);
+    // Headless runs draw into an offscreen framebuffer of the screen size
+    if (window == NULL) {
+        *width = SCREEN_WIDTH;
+        *height = SCREEN_HEIGHT;
+        return;
+    }
+
+    glfwGetFramebufferSize(window, width, height);
 }
 
 #endif
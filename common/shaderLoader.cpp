@@ -4,84 +4,87 @@
 #include <opengl.hpp>
 #include <shaderLoader.hpp>
 
-GLuint loadShaders(std::string vertex_file_path_s, std::string fragment_file_path_s) {
-    vertex_file_path_s = std::string(SHADER_PATH) + vertex_file_path_s + std::string(".glsl");
-    fragment_file_path_s = std::string(SHADER_PATH) + fragment_file_path_s + std::string(".glsl");
-
-    const char* vertex_file_path = vertex_file_path_s.c_str();
-    const char* fragment_file_path = fragment_file_path_s.c_str();
-
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if(VertexShaderStream.is_open()){
-        std::string Line = "";
-        while(getline(VertexShaderStream, Line))
-            VertexShaderCode += "\n" + Line;
-        VertexShaderStream.close();
-    } else {
-        printf("Impossible to open %s. Are you in the right directory?!\n", vertex_file_path);
-        getchar();
-        return 0;
+// Reads a shader file, expanding #include "file" lines with files relative to the shader directory
+static bool readShaderSource(std::string file_path, std::string &ShaderCode) {
+    std::ifstream ShaderStream(file_path.c_str(), std::ios::in);
+    if(!ShaderStream.is_open()){
+        printf("Impossible to open %s. Are you in the right directory?!\n", file_path.c_str());
+        return false;
+    }
+
+    std::string Line = "";
+    while(getline(ShaderStream, Line)){
+        if (Line.compare(0, 9, "#include ") == 0) {
+            size_t begin = Line.find('"');
+            size_t end = Line.rfind('"');
+            std::string IncludePath = std::string(SHADER_PATH) + Line.substr(begin + 1, end - begin - 1);
+
+            if (!readShaderSource(IncludePath, ShaderCode)) return false;
+        } else {
+            ShaderCode += "\n" + Line;
+        }
     }
+    ShaderStream.close();
+
+    return true;
+}
+
+// Permutation defines go straight after the #version line, which has to come first
+static void insertDefines(std::string &ShaderCode, std::string defines) {
+    if (defines.empty()) return;
 
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open()){
-        std::string Line = "";
-        while(getline(FragmentShaderStream, Line))
-            FragmentShaderCode += "\n" + Line;
-        FragmentShaderStream.close();
-    } else {
-        printf("Impossible to open %s. Are you in the right directory?!\n", vertex_file_path);
+    size_t VersionEnd = ShaderCode.find('\n', ShaderCode.find("#version"));
+    if (VersionEnd == std::string::npos) VersionEnd = ShaderCode.size();
+
+    ShaderCode.insert(VersionEnd, "\n" + defines);
+}
+
+// Reads, compiles and checks one stage, exits if it does not compile
+static GLuint compileStage(GLenum type, std::string file_path, std::string defines) {
+    std::string ShaderCode;
+    if(!readShaderSource(file_path, ShaderCode)){
         getchar();
         return 0;
     }
+    insertDefines(ShaderCode, defines);
+
+    GLuint ShaderID = glCreateShader(type);
 
     GLint Result = GL_FALSE;
     int InfoLogLength;
 
-    // Compile Vertex Shader
-    printf("Compiling shader : %s\n", vertex_file_path);
-    char const * VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-    glCompileShader(VertexShaderID);
+    // Compile Shader
+    printf("Compiling shader : %s\n", file_path.c_str());
+    char const * SourcePointer = ShaderCode.c_str();
+    glShaderSource(ShaderID, 1, &SourcePointer , NULL);
+    glCompileShader(ShaderID);
 
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+    // Check Shader
+    glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+    glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
     if ( InfoLogLength > 0 ){
-        std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-        printf("%s\n", &VertexShaderErrorMessage[0]);
+        std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+        glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+        printf("%s\n", &ShaderErrorMessage[0]);
     }
-
-    // Compile Fragment Shader
-    printf("Compiling shader : %s\n", fragment_file_path);
-    char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-    glCompileShader(FragmentShaderID);
-
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-        std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-        printf("%s\n", &FragmentShaderErrorMessage[0]);
+    if ( Result == GL_FALSE ){
         exit(-1);
     }
 
+    return ShaderID;
+}
+
+// Links the stages into a program and releases them, exits if it does not link
+static GLuint linkProgram(std::vector<GLuint> ShaderIDs) {
+    GLint Result = GL_FALSE;
+    int InfoLogLength;
+
     // Link the program
     printf("Linking program\n");
     GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
+    for (GLuint ShaderID : ShaderIDs) {
+        glAttachShader(ProgramID, ShaderID);
+    }
     glLinkProgram(ProgramID);
 
     // Check the program
@@ -91,14 +94,32 @@ GLuint loadShaders(std::string vertex_file_path_s, std::string fragment_file_pat
         std::vector<char> ProgramErrorMessage(InfoLogLength+1);
         glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
         printf("%s\n", &ProgramErrorMessage[0]);
+    }
+    if ( Result == GL_FALSE ){
         exit(-1);
     }
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
-
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+    for (GLuint ShaderID : ShaderIDs) {
+        glDetachShader(ProgramID, ShaderID);
+        glDeleteShader(ShaderID);
+    }
 
     return ProgramID;
 }
+
+GLuint loadShaders(std::string vertex_file_path, std::string fragment_file_path, std::string defines) {
+    GLuint VertexShaderID = compileStage(GL_VERTEX_SHADER, std::string(SHADER_PATH) + vertex_file_path + std::string(".glsl"), defines);
+    if (VertexShaderID == 0) return 0;
+
+    GLuint FragmentShaderID = compileStage(GL_FRAGMENT_SHADER, std::string(SHADER_PATH) + fragment_file_path + std::string(".glsl"), defines);
+    if (FragmentShaderID == 0) return 0;
+
+    return linkProgram({ VertexShaderID, FragmentShaderID });
+}
+
+GLuint loadComputeShader(std::string compute_file_path, std::string defines) {
+    GLuint ComputeShaderID = compileStage(GL_COMPUTE_SHADER, std::string(SHADER_PATH) + compute_file_path + std::string(".glsl"), defines);
+    if (ComputeShaderID == 0) return 0;
+
+    return linkProgram({ ComputeShaderID });
+}
@@ -1,6 +1,8 @@
 #ifndef SHADERLOADER_H
 #define SHADERLOADER_H
 
-GLuint loadShaders(std::string vertex_file_path, std::string fragment_file_path);
+// Shader files may #include "file" relative to the shader directory, defines are added after #version
+GLuint loadShaders(std::string vertex_file_path, std::string fragment_file_path, std::string defines = "");
+GLuint loadComputeShader(std::string compute_file_path, std::string defines = "");
 
 #endif
@@ -0,0 +1,40 @@
+#include <threadPool.hpp>
+
+ThreadPool::ThreadPool(int numThreads) {
+    stopping = false;
+
+    for (int i = 0; i < numThreads; i++) {
+        workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    // Queued jobs are finished before the workers exit
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+            if (jobs.empty()) return;
+
+            job = jobs.front();
+            jobs.pop();
+        }
+
+        job();
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Runs queued jobs on a fixed set of worker threads, jobs start in the order they were submitted
+class ThreadPool {
+
+public:
+
+    // Setup
+    ThreadPool(int numThreads);
+    ~ThreadPool();
+
+    // Queue a job, its result or exception is collected through the returned future
+    template <typename Result>
+    std::future<Result> submit(std::function<Result()> job) {
+        std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(job);
+        std::future<Result> result = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task]() { (*task)(); });
+        }
+        jobAvailable.notify_one();
+
+        return result;
+    }
+
+private:
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+
+    void work();
+
+};
+
+#endif
@@ -0,0 +1,35 @@
+#version 330 core
+
+uniform sampler2D valueTexture;
+
+uniform mat4 MVP;
+uniform int valueSource;
+uniform vec2 origin;
+uniform float barSpacing;
+uniform vec2 barSize;
+
+// How each bar reads its value from the texture
+const int FETCH_VALUE = 0;
+const int LOG_SPECTRUM = 1;
+
+const vec2 corners[4] = vec2[](
+    vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(0.0f, 1.0f), vec2(1.0f, 1.0f)
+);
+
+void main() {
+    float value;
+
+    if (valueSource == LOG_SPECTRUM) {
+
+        // Bars are spaced evenly over the log of the bin index, linear filtering blends the two nearest bins
+        int numBins = textureSize(valueTexture, 0).x;
+        float index = pow(10.0f, gl_InstanceID / float(numBins) * log(float(numBins)) / log(10.0f));
+        value = texture(valueTexture, vec2((index + 0.5f) / numBins, 0.5f)).r;
+    } else {
+        value = texelFetch(valueTexture, ivec2(gl_InstanceID, 0), 0).r;
+    }
+
+    vec2 corner = corners[gl_VertexID];
+    vec2 position = origin + vec2(gl_InstanceID * barSpacing, 0.0f) + corner * vec2(barSize.x, value * barSize.y);
+    gl_Position = MVP * vec4(position, 0.0f, 1.0f);
+}
@@ -0,0 +1,46 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform int screenWidth;
+uniform int screenHeight;
+
+uniform sampler2D sourceTexture;
+
+// Catmull-Rom filtering with nine bilinear taps, the two middle weights of each axis share a tap
+vec4 sampleCatmullRom(sampler2D source, vec2 uv) {
+    vec2 size = vec2(textureSize(source, 0));
+    vec2 position = uv * size;
+    vec2 center = floor(position - 0.5f) + 0.5f;
+    vec2 f = position - center;
+
+    vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    vec2 w3 = f * f * (-0.5f + 0.5f * f);
+    vec2 w12 = w1 + w2;
+
+    vec2 uv0 = (center - 1.0f) / size;
+    vec2 uv12 = (center + w2 / w12) / size;
+    vec2 uv3 = (center + 2.0f) / size;
+
+    vec4 result = vec4(0.0f);
+    result += texture(source, vec2(uv0.x, uv0.y)) * w0.x * w0.y;
+    result += texture(source, vec2(uv12.x, uv0.y)) * w12.x * w0.y;
+    result += texture(source, vec2(uv3.x, uv0.y)) * w3.x * w0.y;
+    result += texture(source, vec2(uv0.x, uv12.y)) * w0.x * w12.y;
+    result += texture(source, vec2(uv12.x, uv12.y)) * w12.x * w12.y;
+    result += texture(source, vec2(uv3.x, uv12.y)) * w3.x * w12.y;
+    result += texture(source, vec2(uv0.x, uv3.y)) * w0.x * w3.y;
+    result += texture(source, vec2(uv12.x, uv3.y)) * w12.x * w3.y;
+    result += texture(source, vec2(uv3.x, uv3.y)) * w3.x * w3.y;
+
+    return result;
+}
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / vec2(screenWidth, screenHeight);
+
+    // The negative lobes overshoot at hard edges, colours below zero would show as dark rings
+    color = max(sampleCatmullRom(sourceTexture, uv), 0.0f);
+}
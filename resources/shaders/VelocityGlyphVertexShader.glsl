@@ -0,0 +1,38 @@
+#version 330 core
+
+uniform sampler2D velocityTexture;
+
+uniform mat4 MVP;
+uniform int screenWidth;
+uniform int screenHeight;
+uniform int gridSize;
+uniform int stride;
+uniform float magnitude;
+uniform vec2 glyphSize;
+
+const vec2 corners[4] = vec2[](
+    vec2(-0.5f, 0.0f), vec2(0.5f, 0.0f), vec2(-0.5f, 1.0f), vec2(0.5f, 1.0f)
+);
+
+void main() {
+    int glyphsAcross = (gridSize + stride - 1) / stride;
+    vec2 cell = vec2(gl_InstanceID % glyphsAcross, gl_InstanceID / glyphsAcross) * stride + stride * 0.5f;
+
+    // Velocity is in screen units, sampled at the centre of the cells the glyph stands for
+    vec2 velocity = texture(velocityTexture, cell / gridSize).rg;
+    float speed = length(velocity);
+
+    // Still cells have no direction, collapse them into a degenerate triangle
+    if (speed == 0.0f) {
+        gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    // Rotate the glyph's up axis onto the velocity direction
+    vec2 direction = velocity / speed;
+    mat2 rotate = mat2(direction.y, -direction.x, direction.x, direction.y);
+
+    vec2 corner = corners[gl_VertexID] * glyphSize * clamp(speed * magnitude, 0.5f, 2.0f);
+    vec2 position = cell * vec2(screenWidth, screenHeight) / gridSize + rotate * corner;
+    gl_Position = MVP * vec4(position, 0.0f, 1.0f);
+}
@@ -10,8 +10,15 @@ uniform int screenHeight;
 uniform sampler2D textureA;
 uniform sampler2D textureB;
 
+#include "include/audio.glsl"
+
 void main() {
     vec3 a = texture(textureA, UV).rgb / 5.0f;
 
+    // The bands are emitted mirrored out from the centre, so smoke brightens with the band emitted below it
+    int numBands = textureSize(bandTexture, 0).x;
+    int band = min(int(abs(UV.x - 0.5f) * 2.0f * numBands), numBands - 1);
+    a *= 1.0f + clamp(audioBand(band) / 20.0f, 0.0f, 1.0f) * 0.5f;
+
     color = vec4(a.r, a.g, a.b, 1.0f);
 }
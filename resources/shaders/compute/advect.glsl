@@ -0,0 +1,112 @@
+#version 430 core
+
+#define TILE_SIZE 16
+#define HALO 4
+#define REGION (TILE_SIZE + 2 * HALO)
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D velocityTexture;
+layout(binding = 1) uniform sampler2D sourceTexture;
+layout(binding = 0) writeonly uniform image2D destinationImage;
+
+uniform int gridSize;
+uniform float gridSpacing;
+uniform float dissipation;
+uniform int traceSubsteps;
+
+uniform float turbulence;
+
+uniform float quantization;
+
+#include "include/frameUniforms.glsl"
+
+#include "include/boundary.glsl"
+
+// Cells around the tile, most back traces stay within them
+shared vec2 velocityTile[REGION * REGION];
+shared vec2 sourceTile[REGION * REGION];
+
+// First cells of the staged tiles, including their halos
+ivec2 sourceOrigin() {
+    return ivec2(gl_WorkGroupID.xy) * TILE_SIZE - HALO;
+}
+
+ivec2 velocityOrigin() {
+    return ivec2(floor(vec2(gl_WorkGroupID.xy * TILE_SIZE) * gridSpacing / velocityGridSpacing)) - HALO;
+}
+
+vec2 fetchGridValue(sampler2D source, ivec2 cell, int size) {
+    return fetchCell(source, cell, size).xy;
+}
+
+vec2 getInterpolatedValue(sampler2D source, vec2 p, int size) {
+    ivec2 cell = ivec2(floor(p));
+    vec2 f = p - vec2(cell);
+
+    return mix(mix(fetchGridValue(source, cell, size), fetchGridValue(source, cell + ivec2(1, 0), size), f.x),
+               mix(fetchGridValue(source, cell + ivec2(0, 1), size), fetchGridValue(source, cell + ivec2(1, 1), size), f.x), f.y);
+}
+
+// Bilinear lookup from the staged tile, long traces that leave it read straight from the texture
+vec2 getInterpolatedVelocity(vec2 p) {
+    ivec2 local = ivec2(floor(p)) - velocityOrigin();
+
+    if (any(lessThan(local, ivec2(0))) || any(greaterThanEqual(local, ivec2(REGION - 1)))) {
+        return getInterpolatedValue(velocityTexture, p, velocityGridSize);
+    }
+
+    vec2 f = fract(p);
+    int k = local.y * REGION + local.x;
+
+    return mix(mix(velocityTile[k], velocityTile[k + 1], f.x),
+               mix(velocityTile[k + REGION], velocityTile[k + REGION + 1], f.x), f.y);
+}
+
+vec2 getInterpolatedSource(vec2 p) {
+    ivec2 local = ivec2(floor(p)) - sourceOrigin();
+
+    if (any(lessThan(local, ivec2(0))) || any(greaterThanEqual(local, ivec2(REGION - 1)))) {
+        return getInterpolatedValue(sourceTexture, p, gridSize);
+    }
+
+    vec2 f = fract(p);
+    int k = local.y * REGION + local.x;
+
+    return mix(mix(sourceTile[k], sourceTile[k + 1], f.x),
+               mix(sourceTile[k + REGION], sourceTile[k + REGION + 1], f.x), f.y);
+}
+
+// Evaluating staggered grid velocities using central differences
+vec2 getVelocity(vec2 position) {
+    vec2 p = position / velocityGridSpacing;
+
+    return vec2((getInterpolatedVelocity(p - vec2(0.5f, 0.0f)).x + getInterpolatedVelocity(p + vec2(0.5f, 0.0f)).x) * 0.5f,
+                (getInterpolatedVelocity(p - vec2(0.0f, 0.5f)).y + getInterpolatedVelocity(p + vec2(0.0f, 0.5f)).y) * 0.5f);
+}
+
+#include "include/trace.glsl"
+
+void main() {
+    // Stage the tile and its halo in shared memory
+    for (int k = int(gl_LocalInvocationIndex); k < REGION * REGION; k += TILE_SIZE * TILE_SIZE) {
+        ivec2 local = ivec2(k % REGION, k / REGION);
+        velocityTile[k] = fetchGridValue(velocityTexture, velocityOrigin() + local, velocityGridSize);
+        sourceTile[k] = fetchGridValue(sourceTexture, sourceOrigin() + local, gridSize);
+    }
+
+    barrier();
+
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(cell, ivec2(gridSize)))) return;
+
+    vec2 tracePosition = traceParticle(vec2(cell) * gridSpacing, timeStep);
+    vec2 newValue = getInterpolatedSource(tracePosition / gridSpacing) * dissipation;
+
+    // Dither 8 bit destinations so slowly dissipating values still round down over time
+    if (quantization > 0.0f) {
+        newValue += (hash(ivec3(cell, frameNumber)) - 0.5f) * quantization;
+    }
+
+    imageStore(destinationImage, cell, vec4(newValue, 0.0f, 0.0f));
+}
@@ -0,0 +1,107 @@
+#version 430 core
+
+#define TILE_SIZE 16
+#define HALO 2
+#define REGION (TILE_SIZE + 2 * HALO)
+#define CURL_REGION (TILE_SIZE + 2)
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D velocityTexture;
+layout(binding = 1) uniform sampler2D temperatureTexture;
+layout(binding = 2) uniform sampler2D densityTexture;
+layout(binding = 0) writeonly uniform image2D velocityImage;
+layout(binding = 1) writeonly uniform image2D curlImage;
+
+uniform int gridSize;
+uniform int scale;
+
+uniform bool buoyancy;
+uniform float fallForce;
+uniform float riseForce;
+uniform float atmosphereTemperature;
+uniform float gravity;
+
+uniform bool vorticityConfinement;
+uniform float vorticityConfinementForce;
+
+#include "include/frameUniforms.glsl"
+
+#include "include/boundary.glsl"
+
+// Velocity after buoyancy, with the two cell halo the curl gradient needs
+shared vec2 velocityTile[REGION * REGION];
+shared float curlTile[CURL_REGION * CURL_REGION];
+
+bool outside(ivec2 cell) {
+    return any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(gridSize)));
+}
+
+vec2 getTileVelocity(ivec2 local) {
+    return velocityTile[local.y * REGION + local.x];
+}
+
+float getTileCurl(ivec2 local) {
+    return curlTile[local.y * CURL_REGION + local.x];
+}
+
+void main() {
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE;
+
+    // Buoyancy is applied as the velocity tile is staged
+    for (int k = int(gl_LocalInvocationIndex); k < REGION * REGION; k += TILE_SIZE * TILE_SIZE) {
+        ivec2 cell = tileOrigin - HALO + ivec2(k % REGION, k / REGION);
+        vec2 v = vec2(0.0f);
+
+        if (wrapBorders || !outside(cell)) {
+            cell = wrapCell(cell, gridSize);
+            v = texelFetch(velocityTexture, cell, 0).xy;
+
+            if (buoyancy) {
+                float temperature = texelFetch(temperatureTexture, cell * scale, 0).r;
+                float density = texelFetch(densityTexture, cell * scale, 0).r;
+                v += (fallForce * density - riseForce * (temperature - atmosphereTemperature)) * vec2(0.0f, gravity / abs(gravity));
+            }
+        }
+
+        velocityTile[k] = v;
+    }
+
+    barrier();
+
+    for (int k = int(gl_LocalInvocationIndex); k < CURL_REGION * CURL_REGION; k += TILE_SIZE * TILE_SIZE) {
+        ivec2 local = ivec2(k % CURL_REGION, k / CURL_REGION) + (HALO - 1);
+        float curl = 0.0f;
+
+        if (wrapBorders || !outside(tileOrigin - HALO + local)) {
+            float pdx = (getTileVelocity(local + ivec2(1, 0)).y - getTileVelocity(local - ivec2(1, 0)).y) * 0.5f;
+            float pdy = (getTileVelocity(local + ivec2(0, 1)).x - getTileVelocity(local - ivec2(0, 1)).x) * 0.5f;
+            curl = pdx - pdy;
+        }
+
+        curlTile[k] = curl;
+    }
+
+    barrier();
+
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (outside(cell)) return;
+
+    ivec2 local = ivec2(gl_LocalInvocationID.xy) + 1;
+    float curl = getTileCurl(local);
+    vec2 v = getTileVelocity(local + (HALO - 1));
+
+    if (vorticityConfinement) {
+        vec3 magnitude = vec3(abs(getTileCurl(local + ivec2(1, 0))) - abs(getTileCurl(local - ivec2(1, 0))),
+                              abs(getTileCurl(local + ivec2(0, 1))) - abs(getTileCurl(local - ivec2(0, 1))), 0.0f);
+
+        float length = length(magnitude);
+        magnitude = length > 0.0f ? (magnitude / length) : vec3(0.0f);
+
+        vec3 force = timeStep * vorticityConfinementForce * cross(magnitude, vec3(0.0f, 0.0f, curl));
+        v += force.xy;
+    }
+
+    imageStore(velocityImage, cell, vec4(v, 0.0f, 0.0f));
+    imageStore(curlImage, cell, vec4(curl, 0.0f, 0.0f, 0.0f));
+}
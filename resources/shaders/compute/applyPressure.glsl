@@ -0,0 +1,29 @@
+#version 430 core
+
+#define TILE_SIZE 16
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D pressureTexture;
+layout(binding = 1) uniform sampler2D velocityTexture;
+layout(binding = 0) writeonly uniform image2D velocityImage;
+
+uniform int gridSize;
+uniform float gradientScale;
+
+#include "include/boundary.glsl"
+
+float getGridPressure(ivec2 cell) {
+    return fetchClampedCell(pressureTexture, cell, gridSize).x;
+}
+
+void main() {
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(cell, ivec2(gridSize)))) return;
+
+    float xChange = getGridPressure(cell + ivec2(1, 0)) - getGridPressure(cell - ivec2(1, 0));
+    float yChange = getGridPressure(cell + ivec2(0, 1)) - getGridPressure(cell - ivec2(0, 1));
+
+    vec2 v = texelFetch(velocityTexture, cell, 0).xy + gradientScale * vec2(xChange, yChange);
+    imageStore(velocityImage, cell, vec4(v, 0.0f, 0.0f));
+}
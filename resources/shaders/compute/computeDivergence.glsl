@@ -0,0 +1,51 @@
+#version 430 core
+
+#define TILE_SIZE 16
+#define HALO 2
+#define REGION (TILE_SIZE + 2 * HALO)
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D velocityTexture;
+layout(binding = 0) writeonly uniform image2D divergenceImage;
+
+uniform int gridSize;
+uniform float gradientScale;
+
+#include "include/boundary.glsl"
+
+shared vec2 velocityTile[REGION * REGION];
+
+bool outside(ivec2 cell) {
+    return any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(gridSize)));
+}
+
+vec2 getTileVelocity(ivec2 local) {
+    return velocityTile[local.y * REGION + local.x];
+}
+
+// Staggered velocity at a cell, averaged from the faces either side of it
+vec2 getVelocity(ivec2 local) {
+    return vec2(getTileVelocity(local - ivec2(1, 0)).x + 2.0f * getTileVelocity(local).x + getTileVelocity(local + ivec2(1, 0)).x,
+                getTileVelocity(local - ivec2(0, 1)).y + 2.0f * getTileVelocity(local).y + getTileVelocity(local + ivec2(0, 1)).y) * 0.25f;
+}
+
+void main() {
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE;
+
+    for (int k = int(gl_LocalInvocationIndex); k < REGION * REGION; k += TILE_SIZE * TILE_SIZE) {
+        ivec2 cell = tileOrigin - HALO + ivec2(k % REGION, k / REGION);
+        velocityTile[k] = fetchCell(velocityTexture, cell, gridSize).xy;
+    }
+
+    barrier();
+
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (outside(cell)) return;
+
+    ivec2 local = ivec2(gl_LocalInvocationID.xy) + HALO;
+    float d = getVelocity(local + ivec2(1, 0)).x - getVelocity(local - ivec2(1, 0)).x +
+              getVelocity(local + ivec2(0, 1)).y - getVelocity(local - ivec2(0, 1)).y;
+
+    imageStore(divergenceImage, cell, vec4(gradientScale * d, 0.0f, 0.0f, 0.0f));
+}
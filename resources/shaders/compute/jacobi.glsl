@@ -0,0 +1,79 @@
+#version 430 core
+
+#define GROUP_SIZE 16
+#define TILE_SIZE 32
+#define MAX_ITERATIONS 4
+#define HALO (2 * MAX_ITERATIONS)
+#define REGION (TILE_SIZE + 2 * HALO)
+#define REGION_CELLS (REGION * REGION)
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+layout(binding = 0) uniform sampler2D divergenceTexture;
+layout(binding = 1) uniform sampler2D pressureTexture;
+layout(binding = 0) writeonly uniform image2D pressureImage;
+
+uniform int gridSize;
+uniform int iterations;
+
+#include "include/boundary.glsl"
+
+// Each iteration invalidates two more cells from the edge of the halo, leaving the tile exact
+shared float divergenceTile[REGION_CELLS];
+shared float pressureTile[2 * REGION_CELLS];
+
+// First cell of the staged tile, including its halo
+ivec2 origin() {
+    return ivec2(gl_WorkGroupID.xy) * TILE_SIZE - HALO;
+}
+
+bool outside(ivec2 cell) {
+    return any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(gridSize)));
+}
+
+float getTilePressure(int tile, ivec2 cell) {
+    if (!wrapBorders) cell = clamp(cell, ivec2(0), ivec2(gridSize - 1));
+    ivec2 local = clamp(cell - origin(), ivec2(0), ivec2(REGION - 1));
+    return pressureTile[tile * REGION_CELLS + local.y * REGION + local.x];
+}
+
+void main() {
+    for (int k = int(gl_LocalInvocationIndex); k < REGION_CELLS; k += GROUP_SIZE * GROUP_SIZE) {
+        ivec2 cell = origin() + ivec2(k % REGION, k / REGION);
+        divergenceTile[k] = fetchCell(divergenceTexture, cell, gridSize).x;
+        pressureTile[k] = fetchCell(pressureTexture, cell, gridSize).x;
+    }
+
+    barrier();
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        int source = iteration & 1;
+
+        for (int k = int(gl_LocalInvocationIndex); k < REGION_CELLS; k += GROUP_SIZE * GROUP_SIZE) {
+            ivec2 cell = origin() + ivec2(k % REGION, k / REGION);
+            float p = pressureTile[source * REGION_CELLS + k];
+
+            if (wrapBorders || !outside(cell)) {
+                p = (divergenceTile[k] +
+                     getTilePressure(source, cell + ivec2(2, 0)) +
+                     getTilePressure(source, cell - ivec2(2, 0)) +
+                     getTilePressure(source, cell + ivec2(0, 2)) +
+                     getTilePressure(source, cell - ivec2(0, 2))) * 0.25f;
+            }
+
+            pressureTile[(1 - source) * REGION_CELLS + k] = p;
+        }
+
+        barrier();
+    }
+
+    // Each invocation writes a 2x2 block of the tile
+    for (int k = 0; k < 4; k++) {
+        ivec2 local = ivec2(gl_LocalInvocationID.xy) * 2 + ivec2(k & 1, k >> 1) + HALO;
+        ivec2 cell = origin() + local;
+        if (outside(cell)) continue;
+
+        float p = pressureTile[(iterations & 1) * REGION_CELLS + local.y * REGION + local.x];
+        imageStore(pressureImage, cell, vec4(p, 0.0f, 0.0f, 0.0f));
+    }
+}
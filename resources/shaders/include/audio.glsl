@@ -0,0 +1,24 @@
+// Audio features published by the analyzer once per frame
+uniform sampler2D spectrumTexture;
+uniform sampler2D bandTexture;
+uniform sampler2D bandHistoryTexture;
+
+// Row of the band history ring written last
+uniform int bandHistoryRow;
+
+// Spectrum magnitude at a frequency from 0 to 1 across the bins, blended between neighbouring bins
+float audioSpectrum(float frequency) {
+    return texture(spectrumTexture, vec2(frequency, 0.5f)).r;
+}
+
+// Decibel level of a band
+float audioBand(int band) {
+    return texelFetch(bandTexture, ivec2(band, 0), 0).r;
+}
+
+// Decibel level of a band the given number of frames ago, up to the length of the history
+float audioBandHistory(int band, int framesAgo) {
+    int rows = textureSize(bandHistoryTexture, 0).y;
+    int row = (bandHistoryRow - framesAgo % rows + rows) % rows;
+    return texelFetch(bandHistoryTexture, ivec2(band, row), 0).r;
+}
@@ -0,0 +1,34 @@
+// Boundary handling, compiled in per program with WRAP_BORDERS defined for periodic grids.
+// Bounded grids read zero past their edges, bilinear lookups get the same from the sampler.
+#ifdef WRAP_BORDERS
+const bool wrapBorders = true;
+#else
+const bool wrapBorders = false;
+#endif
+
+bool outsideGrid(ivec2 cell, int size) {
+    return any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(size)));
+}
+
+// Cell a periodic grid maps any index onto
+ivec2 wrapCell(ivec2 cell, int size) {
+    return ivec2(mod(vec2(cell), float(size)));
+}
+
+// Value of a cell, zero past the edges of a bounded grid
+vec4 fetchCell(sampler2D source, ivec2 cell, int size) {
+#ifdef WRAP_BORDERS
+    return texelFetch(source, wrapCell(cell, size), 0);
+#else
+    return outsideGrid(cell, size) ? vec4(0.0f) : texelFetch(source, cell, 0);
+#endif
+}
+
+// Value of a cell, held at the nearest edge cell of a bounded grid
+vec4 fetchClampedCell(sampler2D source, ivec2 cell, int size) {
+#ifdef WRAP_BORDERS
+    return texelFetch(source, wrapCell(cell, size), 0);
+#else
+    return texelFetch(source, clamp(cell, ivec2(0), ivec2(size - 1)), 0);
+#endif
+}
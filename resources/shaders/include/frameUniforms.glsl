@@ -0,0 +1,10 @@
+// Per frame constants shared by every program
+layout(std140) uniform FrameUniforms {
+    int velocityGridSize;
+    float velocityInverseSize;
+    float velocityGridSpacing;
+    float timeStep;
+    float turbulenceFrequency;
+    float turbulenceTime;
+    int frameNumber;
+};
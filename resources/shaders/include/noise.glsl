@@ -0,0 +1,17 @@
+float hash(ivec3 p) {
+    uint h = (uint(p.x) * 73856093u) ^ (uint(p.y) * 19349663u) ^ (uint(p.z) * 83492791u);
+    h = (h ^ (h >> 13u)) * 1274126177u;
+    h = h ^ (h >> 16u);
+    return float(h & 0xffffu) / 65535.0f;
+}
+
+float noise(vec3 p) {
+    ivec3 i = ivec3(floor(p));
+    vec3 f = fract(p);
+    vec3 u = f * f * (3.0f - 2.0f * f);
+
+    return mix(mix(mix(hash(i), hash(i + ivec3(1, 0, 0)), u.x),
+                   mix(hash(i + ivec3(0, 1, 0)), hash(i + ivec3(1, 1, 0)), u.x), u.y),
+               mix(mix(hash(i + ivec3(0, 0, 1)), hash(i + ivec3(1, 0, 1)), u.x),
+                   mix(hash(i + ivec3(0, 1, 1)), hash(i + ivec3(1, 1, 1)), u.x), u.y), u.z);
+}
@@ -0,0 +1,24 @@
+// Lookups at grid and world positions for the fragment programs, the sampler's wrap mode handles the edges
+
+// Texture coordinate of a grid position
+vec2 getGridSample(float i, float j, float invSize) {
+    return vec2(i, j) * invSize;
+}
+
+// Bilinear lookup at a grid position
+vec3 getGridValue(sampler2D source, float i, float j, float invSize) {
+    return texture(source, getGridSample(i, j, invSize)).xyz;
+}
+
+// Average of the lookups half a cell either side of a world position
+vec3 getValue(sampler2D source, float x, float y, float spacing, float invSize) {
+    float normX = x / spacing;
+    float normY = y / spacing;
+
+    vec3 v = (getGridValue(source, normX - 0.5f, normY, invSize) +
+         getGridValue(source, normX + 0.5f, normY, invSize) +
+         getGridValue(source, normX, normY - 0.5f, invSize) +
+         getGridValue(source, normX, normY + 0.5f, invSize)) * 0.25f;
+
+    return v;
+}
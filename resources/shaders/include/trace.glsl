@@ -0,0 +1,32 @@
+// Particle back trace shared by the advection programs. Programs declare the traceSubsteps and turbulence
+// uniforms and a getVelocity(vec2 position) lookup in world units before including this.
+#include "include/noise.glsl"
+
+// Divergence free detail velocity, scaled by the local speed of the coarse flow
+vec2 turbulenceAt(vec2 position, float speed) {
+    vec3 p = vec3(position * turbulenceFrequency, turbulenceTime);
+    float e = 0.1f;
+
+    float dx = noise(p + vec3(e, 0.0f, 0.0f)) - noise(p - vec3(e, 0.0f, 0.0f));
+    float dy = noise(p + vec3(0.0f, e, 0.0f)) - noise(p - vec3(0.0f, e, 0.0f));
+
+    return turbulence * speed * vec2(dy, -dx) / (2.0f * e);
+}
+
+// Traces back over a time step with midpoint substeps, a negative step traces forward
+vec2 traceParticle(vec2 position, float step) {
+    float dt = step / traceSubsteps;
+
+    for (int i = 0; i < traceSubsteps; i++) {
+        vec2 v = getVelocity(position);
+        v = getVelocity(position + 0.5f * dt * v);
+
+        if (turbulence > 0.0f) {
+            v += turbulenceAt(position, length(v));
+        }
+
+        position -= dt * v;
+    }
+
+    return position;
+}
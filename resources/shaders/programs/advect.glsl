@@ -4,54 +4,73 @@ layout(location = 0) out vec4 color;
 
 uniform sampler2D velocityTexture;
 uniform sampler2D sourceTexture;
+uniform sampler2D forwardTexture;
+uniform sampler2D backwardTexture;
 
 uniform int gridSize;
 uniform float inverseSize;
-uniform bool wrapBorders;
 uniform float gridSpacing;
-uniform float timeStep;
 uniform float dissipation;
+uniform int traceSubsteps;
+uniform bool macCormack;
+uniform bool backward;
 
-bool clampBoundary(inout float i) {
-    if (i < 0) {
-        i = 0;
-        return true;
-    }  else if (i >= gridSize) {
-        i = gridSize - 1;
-        return true;
-    }
+uniform float turbulence;
 
-    return false;
-}
+uniform float quantization;
 
-vec3 getGridValue(sampler2D source, float i, float j) {
-    bool boundary = !wrapBorders && (clampBoundary(i) || clampBoundary(j));
-    vec2 texcoord = vec2(i, j) * inverseSize;
-    return texture(source, texcoord).xyz * (boundary ? 0.0f : 1.0f);
-}
+#include "include/frameUniforms.glsl"
 
-vec3 getValue(sampler2D source, float x, float y) {
-    float normX = x / float(gridSpacing);
-    float normY = y / float(gridSpacing);
+#include "include/boundary.glsl"
 
-    vec3 v = (getGridValue(source, normX - 0.5f, normY) +
-         getGridValue(source, normX + 0.5f, normY) +
-         getGridValue(source, normX, normY - 0.5f) +
-         getGridValue(source, normX, normY + 0.5f)) * 0.25f;
+#include "include/sampling.glsl"
 
-    return v;
+vec2 getVelocity(vec2 position) {
+    return getValue(velocityTexture, position.x, position.y, velocityGridSpacing, velocityInverseSize).xy;
 }
 
-vec2 traceParticle(float x, float y) {
-    vec2 v = getValue(velocityTexture, x, y).xy;
-    v = getValue(velocityTexture, x + (0.5f * timeStep * v.x), y + (0.5f * timeStep * v.y)).xy;
-    return vec2(x, y) - (timeStep * v);
+#include "include/trace.glsl"
+
+// Corrects the forward step by half the round trip error, limited to the 2x2 source cells the trace interpolates
+vec3 getCorrectedValue(vec2 pos, vec2 tracePosition) {
+    ivec2 cell = ivec2(pos);
+    vec3 forward = texelFetch(forwardTexture, cell, 0).xyz;
+    vec3 backward = texelFetch(backwardTexture, cell, 0).xyz;
+    vec3 source = texelFetch(sourceTexture, cell, 0).xyz * dissipation;
+    vec3 corrected = forward + 0.5f * (source - backward);
+
+    // Cell centres sit half a cell in from their grid positions
+    ivec2 corner = ivec2(floor(tracePosition / gridSpacing - 0.5f));
+    vec3 minimum = vec3(1e20f);
+    vec3 maximum = vec3(-1e20f);
+
+    for (int x = 0; x <= 1; x++) {
+        for (int y = 0; y <= 1; y++) {
+            vec3 v = fetchCell(sourceTexture, corner + ivec2(x, y), gridSize).xyz;
+            minimum = min(minimum, v);
+            maximum = max(maximum, v);
+        }
+    }
+
+    return clamp(corrected, minimum * dissipation, maximum * dissipation);
 }
 
 void main() {
     vec2 pos = gl_FragCoord.xy;
 
-    vec2 tracePosition = traceParticle(pos.x * gridSpacing, pos.y * gridSpacing);
-    vec3 newValue = getValue(sourceTexture, tracePosition.x, tracePosition.y);
-    color = vec4(newValue * dissipation, 0.0f);
+    vec2 tracePosition = traceParticle(pos * gridSpacing, backward ? -timeStep : timeStep);
+    vec3 newValue;
+
+    if (macCormack) {
+        newValue = getCorrectedValue(pos, tracePosition);
+    } else {
+        newValue = getValue(sourceTexture, tracePosition.x, tracePosition.y, gridSpacing, inverseSize) * dissipation;
+    }
+
+    // Dither 8 bit destinations so slowly dissipating values still round down over time
+    if (quantization > 0.0f) {
+        newValue += (hash(ivec3(pos, frameNumber)) - 0.5f) * quantization;
+    }
+
+    color = vec4(newValue, 0.0f);
 }
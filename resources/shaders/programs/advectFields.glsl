@@ -0,0 +1,71 @@
+#version 330 core
+
+layout(location = 0) out vec4 density;
+layout(location = 1) out vec4 temperature;
+layout(location = 2) out vec4 rgb;
+
+uniform sampler2D velocityTexture;
+uniform sampler2D densityTexture;
+uniform sampler2D temperatureTexture;
+uniform sampler2D rgbTexture;
+
+uniform float inverseSize;
+uniform float gridSpacing;
+uniform int traceSubsteps;
+uniform bool advectRgb;
+
+// Density, temperature and rgb in order
+uniform vec3 dissipation;
+uniform vec3 quantization;
+
+uniform float turbulence;
+
+#include "include/frameUniforms.glsl"
+
+#include "include/sampling.glsl"
+
+vec2 getVelocity(vec2 position) {
+    return getValue(velocityTexture, position.x, position.y, velocityGridSpacing, velocityInverseSize).xy;
+}
+
+#include "include/trace.glsl"
+
+void main() {
+    vec2 pos = gl_FragCoord.xy;
+
+    // Every field shares the grid, so one trace and one set of sample positions serves them all
+    vec2 tracePosition = traceParticle(pos * gridSpacing, timeStep);
+    float normX = tracePosition.x / gridSpacing;
+    float normY = tracePosition.y / gridSpacing;
+
+    vec2 samples[4];
+    samples[0] = getGridSample(normX - 0.5f, normY, inverseSize);
+    samples[1] = getGridSample(normX + 0.5f, normY, inverseSize);
+    samples[2] = getGridSample(normX, normY - 0.5f, inverseSize);
+    samples[3] = getGridSample(normX, normY + 0.5f, inverseSize);
+
+    float newDensity = 0.0f;
+    float newTemperature = 0.0f;
+    vec3 newRgb = vec3(0.0f);
+
+    for (int i = 0; i < 4; i++) {
+        newDensity += texture(densityTexture, samples[i]).x;
+        newTemperature += texture(temperatureTexture, samples[i]).x;
+
+        if (advectRgb) {
+            newRgb += texture(rgbTexture, samples[i]).xyz;
+        }
+    }
+
+    vec3 newScalars = vec3(newDensity, newTemperature, 0.0f) * 0.25f * dissipation;
+    newRgb *= 0.25f * dissipation.z;
+
+    // Dither 8 bit destinations so slowly dissipating values still round down over time
+    float dither = hash(ivec3(pos, frameNumber)) - 0.5f;
+    newScalars += dither * quantization;
+    newRgb += dither * quantization.z;
+
+    density = vec4(newScalars.x, 0.0f, 0.0f, 0.0f);
+    temperature = vec4(newScalars.y, 0.0f, 0.0f, 0.0f);
+    rgb = vec4(newRgb, 0.0f);
+}
@@ -5,45 +5,19 @@ layout(location = 0) out vec4 color;
 uniform sampler2D pressureTexture;
 
 uniform int gridSize;
-uniform float inverseSize;
-uniform bool wrapBorders;
 uniform float gradientScale;
 
-float clampIndex(float i) {
-    if (i < 0 && !wrapBorders) {
-        return 0.0f;
-    }  else if (i >= gridSize && !wrapBorders) {
-        return float(gridSize - 1);
-    }
+#include "include/boundary.glsl"
 
-    return i;
-}
-
-bool clampBoundary(inout float i) {
-    if (i < 0) {
-        i = 0;
-        return true;
-    }  else if (i >= gridSize) {
-        i = gridSize - 1;
-        return true;
-    }
-
-    return false;
-}
-
-float getGridPressure(float i, float j) {
-    bool boundary = !wrapBorders && (clampBoundary(i) || clampBoundary(j));
-    vec2 texcoord = vec2(i, j) * inverseSize;
-    return texture(pressureTexture, texcoord).x * (boundary ? 0.0f : 1.0f);
+float getGridPressure(ivec2 cell) {
+    return fetchClampedCell(pressureTexture, cell, gridSize).x;
 }
 
 void main() {
-    vec2 pos = gl_FragCoord.xy;
-    float i = float(pos.x);
-    float j = float(pos.y);
+    ivec2 cell = ivec2(gl_FragCoord.xy);
 
-    float xChange = getGridPressure(clampIndex(i + 1), j) - getGridPressure(clampIndex(i - 1), j);
-    float yChange = getGridPressure(i, clampIndex(j + 1)) - getGridPressure(i, clampIndex(j - 1));
+    float xChange = getGridPressure(cell + ivec2(1, 0)) - getGridPressure(cell - ivec2(1, 0));
+    float yChange = getGridPressure(cell + ivec2(0, 1)) - getGridPressure(cell - ivec2(0, 1));
 
     color = vec4(gradientScale * xChange, gradientScale * yChange, 0.0f, 0.0f);
 }
@@ -5,39 +5,24 @@ layout(location = 0) out vec4 color;
 uniform sampler2D curlTexture;
 
 uniform int gridSize;
-uniform float inverseSize;
-uniform bool wrapBorders;
-uniform float timeStep;
 uniform float vorticityConfinementForce;
 
-bool clampBoundary(inout float i) {
-    if (i < 0) {
-        i = 0;
-        return true;
-    }  else if (i >= gridSize) {
-        i = gridSize - 1;
-        return true;
-    }
+#include "include/frameUniforms.glsl"
 
-    return false;
-}
+#include "include/boundary.glsl"
 
-float getGridCurl(float i, float j) {
-    bool boundary = !wrapBorders && (clampBoundary(i) || clampBoundary(j));
-    vec2 texcoord = vec2(i, j) * inverseSize;
-    return texture(curlTexture, texcoord).x * (boundary ? 0.0f : 1.0f);
+float getGridCurl(ivec2 cell) {
+    return fetchCell(curlTexture, cell, gridSize).x;
 }
 
 void main() {
-    vec2 pos = gl_FragCoord.xy;
-    float i = float(pos.x);
-    float j = float(pos.y);
-
-    float curl = getGridCurl(i, j);
-    float curlLeft = getGridCurl(i - 1, j);
-    float curlRight = getGridCurl(i + 1, j);
-    float curlBottom = getGridCurl(i, j - 1);
-    float curlTop = getGridCurl(i, j + 1);
+    ivec2 cell = ivec2(gl_FragCoord.xy);
+
+    float curl = texelFetch(curlTexture, cell, 0).x;
+    float curlLeft = getGridCurl(cell - ivec2(1, 0));
+    float curlRight = getGridCurl(cell + ivec2(1, 0));
+    float curlBottom = getGridCurl(cell - ivec2(0, 1));
+    float curlTop = getGridCurl(cell + ivec2(0, 1));
 
     vec3 magnitude = vec3(abs(curlRight) - abs(curlLeft), abs(curlTop) - abs(curlBottom), 0.0f);
 
@@ -4,28 +4,13 @@ layout(location = 0) out vec4 color;
 
 uniform sampler2D velocityTexture;
 
-uniform int gridSize;
 uniform float inverseSize;
-uniform bool wrapBorders;
 uniform float gridSpacing;
 uniform float gradientScale;
 
-bool clampBoundary(inout float i) {
-    if (i < 0) {
-        i = 0;
-        return true;
-    }  else if (i >= gridSize) {
-        i = gridSize - 1;
-        return true;
-    }
-
-    return false;
-}
-
+// Bilinear lookup at a grid position, the sampler's wrap mode handles the edges
 vec2 getGridVelocity(sampler2D source, float i, float j) {
-    bool boundary = !wrapBorders && (clampBoundary(i) || clampBoundary(j));
-    vec2 texcoord = vec2(i, j) * inverseSize;
-    return texture(source, texcoord).xy * (boundary ? 0.0f : 1.0f);
+    return texture(source, vec2(i, j) * inverseSize).xy;
 }
 
 vec2 getVelocity(sampler2D source, float x, float y) {
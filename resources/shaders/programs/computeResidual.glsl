@@ -0,0 +1,28 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D divergenceTexture;
+uniform sampler2D pressureTexture;
+
+uniform int gridSize;
+uniform int stride;
+
+#include "include/boundary.glsl"
+
+float getGridPressure(ivec2 cell) {
+    return fetchClampedCell(pressureTexture, cell, gridSize).x;
+}
+
+void main() {
+    ivec2 cell = ivec2(gl_FragCoord.xy);
+
+    float d = texelFetch(divergenceTexture, cell, 0).x;
+    float p = getGridPressure(cell + ivec2(stride, 0)) +
+              getGridPressure(cell - ivec2(stride, 0)) +
+              getGridPressure(cell + ivec2(0, stride)) +
+              getGridPressure(cell - ivec2(0, stride));
+
+    float centre = texelFetch(pressureTexture, cell, 0).x;
+    color = vec4(d - (4.0f * centre - p), 0.0f, 0.0f, 0.0f);
+}
@@ -0,0 +1,62 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D densityTexture;
+uniform sampler2D velocityTexture;
+
+uniform int tileSize;
+uniform int gridSize;
+uniform int velocityScale;
+uniform float rotationScale;
+uniform float refinementThreshold;
+
+#include "include/frameUniforms.glsl"
+
+float getGridDensity(ivec2 p) {
+    return texelFetch(densityTexture, clamp(p, 0, gridSize - 1), 0).x;
+}
+
+vec2 getGridVelocity(ivec2 p) {
+    return texelFetch(velocityTexture, clamp(p, 0, velocityGridSize - 1), 0).xy;
+}
+
+void main() {
+    ivec2 tile = ivec2(gl_FragCoord.xy);
+    ivec2 origin = tile * tileSize;
+    float detail = 0.0f;
+
+    // Steep density edges hold the visible structure
+    for (int x = 0; x < tileSize; x++) {
+        for (int y = 0; y < tileSize; y++) {
+            ivec2 p = origin + ivec2(x, y);
+
+            float xChange = getGridDensity(p + ivec2(1, 0)) - getGridDensity(p - ivec2(1, 0));
+            float yChange = getGridDensity(p + ivec2(0, 1)) - getGridDensity(p - ivec2(0, 1));
+            detail = max(detail, 0.5f * max(abs(xChange), abs(yChange)));
+        }
+    }
+
+    // Rotation per time step of the velocity cells covering the tile
+    int velocityTileSize = max(tileSize / velocityScale, 1);
+    ivec2 velocityOrigin = origin / velocityScale;
+
+    for (int x = 0; x < velocityTileSize; x++) {
+        for (int y = 0; y < velocityTileSize; y++) {
+            ivec2 p = velocityOrigin + ivec2(x, y);
+
+            float pdx = (getGridVelocity(p + ivec2(1, 0)).y - getGridVelocity(p - ivec2(1, 0)).y) * 0.5f;
+            float pdy = (getGridVelocity(p + ivec2(0, 1)).x - getGridVelocity(p - ivec2(0, 1)).x) * 0.5f;
+            detail = max(detail, abs(pdx - pdy) * rotationScale);
+        }
+    }
+
+    float level = 4.0f;
+    if (detail >= refinementThreshold) {
+        level = 1.0f;
+    } else if (detail >= refinementThreshold * 0.25f) {
+        level = 2.0f;
+    }
+
+    color = vec4(level, 0.0f, 0.0f, 0.0f);
+}
@@ -6,46 +6,26 @@ uniform sampler2D divergenceTexture;
 uniform sampler2D pressureTexture;
 
 uniform int gridSize;
-uniform float inverseSize;
-uniform bool wrapBorders;
+uniform int stride;
+uniform float weight;
 
-float clampIndex(float i) {
-    if (i < 0 && !wrapBorders) {
-        return 0.0f;
-    }  else if (i >= gridSize && !wrapBorders) {
-        return float(gridSize - 1);
-    }
+#include "include/boundary.glsl"
 
-    return i;
+// Pressure past the edges of a bounded grid is held at the edge cell, giving no flow through the walls
+float getGridPressure(ivec2 cell) {
+    return fetchClampedCell(pressureTexture, cell, gridSize).x;
 }
 
-bool clampBoundary(inout float i) {
-    if (i < 0) {
-        i = 0;
-        return true;
-    }  else if (i >= gridSize) {
-        i = gridSize - 1;
-        return true;
-    }
+void main() {
+    ivec2 cell = ivec2(gl_FragCoord.xy);
 
-    return false;
-}
+    float d = texelFetch(divergenceTexture, cell, 0).x;
+    float p = getGridPressure(cell + ivec2(stride, 0)) +
+              getGridPressure(cell - ivec2(stride, 0)) +
+              getGridPressure(cell + ivec2(0, stride)) +
+              getGridPressure(cell - ivec2(0, stride));
 
-float getGridPressure(float i, float j) {
-    bool boundary = !wrapBorders && (clampBoundary(i) || clampBoundary(j));
-    vec2 texcoord = vec2(i, j) * inverseSize;
-    return texture(pressureTexture, texcoord).x * (boundary ? 0.0f : 1.0f);
-}
-
-void main() {
-    vec2 pos = gl_FragCoord.xy;
-    float i = float(pos.x);
-    float j = float(pos.y);
-
-    float d = texture(divergenceTexture, pos * inverseSize).x;
-    float p = getGridPressure(clampIndex(i + 2), j) +
-              getGridPressure(clampIndex(i - 2), j) +
-              getGridPressure(i, clampIndex(j + 2)) +
-              getGridPressure(i, clampIndex(j - 2));
-    color = vec4((d + p) * 0.25f, 0.0f, 0.0f, 0.0f);
+    // Damped updates smooth the high frequencies for multigrid, a weight of one is plain Jacobi
+    float centre = texelFetch(pressureTexture, cell, 0).x;
+    color = vec4(mix(centre, (d + p) * 0.25f, weight), 0.0f, 0.0f, 0.0f);
 }
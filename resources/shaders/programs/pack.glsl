@@ -0,0 +1,15 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D sourceTexture;
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+
+    // Each channel holds one cell of the 2x2 block, in the order (0, 0), (1, 0), (0, 1), (1, 1)
+    color = vec4(texelFetch(sourceTexture, p, 0).x,
+                 texelFetch(sourceTexture, p + ivec2(1, 0), 0).x,
+                 texelFetch(sourceTexture, p + ivec2(0, 1), 0).x,
+                 texelFetch(sourceTexture, p + ivec2(1, 1), 0).x);
+}
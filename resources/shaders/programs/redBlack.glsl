@@ -0,0 +1,44 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D divergenceTexture;
+uniform sampler2D pressureTexture;
+
+uniform int gridSize;
+uniform int parity;
+
+vec4 getPressure(ivec2 p) {
+    return texelFetch(pressureTexture, p, 0);
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 centre = getPressure(p);
+
+    // Only one colour is updated per pass, the other is carried over
+    if (((p.x + p.y) & 1) != parity) {
+        color = centre;
+        return;
+    }
+
+    // The stride two stencil links each channel to the same channel of the neighbouring blocks
+    vec4 left, right, down, up;
+
+#ifdef WRAP_BORDERS
+    left = getPressure(ivec2((p.x + gridSize - 1) % gridSize, p.y));
+    right = getPressure(ivec2((p.x + 1) % gridSize, p.y));
+    down = getPressure(ivec2(p.x, (p.y + gridSize - 1) % gridSize));
+    up = getPressure(ivec2(p.x, (p.y + 1) % gridSize));
+#else
+
+    // Past the edges the stencil clamps onto the outermost cells, which share this block
+    left = p.x > 0 ? getPressure(p - ivec2(1, 0)) : centre.rrbb;
+    right = p.x < gridSize - 1 ? getPressure(p + ivec2(1, 0)) : centre.ggaa;
+    down = p.y > 0 ? getPressure(p - ivec2(0, 1)) : centre.rgrg;
+    up = p.y < gridSize - 1 ? getPressure(p + ivec2(0, 1)) : centre.baba;
+#endif
+
+    vec4 d = texelFetch(divergenceTexture, p, 0);
+    color = (d + left + right + down + up) * 0.25f;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D sourceTexture;
+
+uniform int sourceSize;
+uniform bool magnitude;
+
+float getValue(ivec2 p) {
+    vec4 texel = texelFetch(sourceTexture, min(p, ivec2(sourceSize - 1)), 0);
+    return magnitude ? length(texel.xy) : texel.x;
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+
+    // Each texel keeps the largest value of the 2x2 block below it
+    float value = max(max(getValue(p), getValue(p + ivec2(1, 0))),
+                      max(getValue(p + ivec2(0, 1)), getValue(p + ivec2(1, 1))));
+
+    color = vec4(value, 0.0f, 0.0f, 0.0f);
+}
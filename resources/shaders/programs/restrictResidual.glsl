@@ -0,0 +1,15 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D residualTexture;
+
+uniform float inverseSize;
+uniform float scale;
+
+void main() {
+    vec2 pos = gl_FragCoord.xy;
+
+    // Coarse texel centres sit on the shared corner of a 2x2 fine block, so one bilinear fetch averages it
+    color = vec4(texture(residualTexture, pos * inverseSize).x * scale, 0.0f, 0.0f, 0.0f);
+}
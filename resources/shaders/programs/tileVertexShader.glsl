@@ -0,0 +1,26 @@
+#version 330 core
+
+uniform sampler2D tileLevelTexture;
+
+uniform int numTiles;
+uniform int level;
+uniform float padding;
+
+const vec2 corners[6] = vec2[](
+    vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(0.0f, 1.0f),
+    vec2(0.0f, 1.0f), vec2(1.0f, 0.0f), vec2(1.0f, 1.0f)
+);
+
+void main() {
+    ivec2 tile = ivec2(gl_InstanceID % numTiles, gl_InstanceID / numTiles);
+
+    // Collapse tiles of any other level into a degenerate triangle
+    if (int(texelFetch(tileLevelTexture, tile, 0).r) != level) {
+        gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    vec2 corner = corners[gl_VertexID];
+    vec2 position = (vec2(tile) + corner) / numTiles * 2.0f - 1.0f;
+    gl_Position = vec4(position + (corner * 2.0f - 1.0f) * padding, 0.0f, 1.0f);
+}
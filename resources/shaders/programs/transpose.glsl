@@ -0,0 +1,11 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D sourceTexture;
+
+void main() {
+
+    // Rows become columns, matching the column major layout of the CPU fields
+    color = texelFetch(sourceTexture, ivec2(gl_FragCoord.yx), 0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D packedTexture;
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+
+    vec4 block = texelFetch(packedTexture, p / 2, 0);
+    int channel = (p.x & 1) + 2 * (p.y & 1);
+
+    color = vec4(block[channel], 0.0f, 0.0f, 0.0f);
+}
@@ -0,0 +1,35 @@
+#version 330 core
+
+layout(location = 0) out vec4 color;
+
+uniform sampler2D sourceTexture;
+
+uniform float inverseSize;
+
+uniform float quantization;
+
+#include "include/frameUniforms.glsl"
+
+#include "include/noise.glsl"
+
+void main() {
+    vec2 pos = gl_FragCoord.xy;
+
+    // Normalised coordinates line up across levels, so the coarse source is filtered bilinearly
+    vec2 texcoord = pos * inverseSize;
+
+#ifndef WRAP_BORDERS
+    // Hold the outermost coarse cells rather than fading into the zero border of a bounded grid
+    vec2 halfTexel = 0.5f / vec2(textureSize(sourceTexture, 0));
+    texcoord = clamp(texcoord, halfTexel, 1.0f - halfTexel);
+#endif
+
+    vec3 value = texture(sourceTexture, texcoord).xyz;
+
+    // Dither 8 bit destinations so slowly dissipating values still round down over time
+    if (quantization > 0.0f) {
+        value += (hash(ivec3(pos, frameNumber)) - 0.5f) * quantization;
+    }
+
+    color = vec4(value, 0.0f);
+}
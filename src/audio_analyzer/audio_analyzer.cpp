@@ -16,36 +16,45 @@ static int paCallback(const void *inputBuffer,
                       PaStreamCallbackFlags statusFlags,
                       void *userData);
 
-AudioAnalyzer::AudioAnalyzer() {
+AudioAnalyzer::AudioAnalyzer(bool openInput) {
     spacing = SCREEN_WIDTH / ((float) SAMPLE_SIZE);
     bandSpacing = SCREEN_WIDTH / ((float) NUM_BANDS);
 
     // Setup VBOs
-    float waveformVertices[SAMPLE_SIZE * 2] = {};
+    glGenBuffers(1, &overlayVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, overlayVBO);
+    glBufferData(GL_ARRAY_BUFFER, OVERLAY_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
 
-    glGenBuffers(1, &waveformVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, waveformVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(waveformVertices), waveformVertices, GL_STATIC_DRAW);
+    // Setup VAOs
+    GLint boundVertexArray;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVertexArray);
+    defaultVertexArray = (GLuint) boundVertexArray;
 
-    float squareVertices[] = {
-            0.0f, 0.0f,
-            0.0f, 1.0f,
-            1.0f, 1.0f,
-            1.0f, 0.0f,
-    };
-    glGenBuffers(1, &squareVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareVertices), squareVertices, GL_STATIC_DRAW);
+    glGenVertexArrays(1, &overlayVertexArray);
+    glBindVertexArray(overlayVertexArray);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glBindVertexArray(defaultVertexArray);
 
-    shader = loadShaders("SimpleVertexShader", "SimpleFragmentShader");
+    // Setup feature textures
+    spectrumTexture = createFeatureTexture(SAMPLE_SIZE / 2, 1);
+    bandTexture = createFeatureTexture(NUM_BANDS, 1);
+    bandHistoryTexture = createFeatureTexture(NUM_BANDS, BAND_HISTORY_SIZE);
+    bandHistoryRow = 0;
 
-    // Initialize audio features
-    PaError err = Pa_Initialize();
-    if (paErrorOccured(err)) {
-        return;
-    } else {
-        paInitSuccessful = true;
-    }
+    // Setup shaders
+    shader = loadShaders("SimpleVertexShader", "SimpleFragmentShader");
+    transformLocation = glGetUniformLocation(shader, "MVP");
+
+    barShader = loadShaders("BarVertexShader", "SimpleFragmentShader");
+    barTransformLocation = glGetUniformLocation(barShader, "MVP");
+    valueSourceLocation = glGetUniformLocation(barShader, "valueSource");
+    originLocation = glGetUniformLocation(barShader, "origin");
+    barSpacingLocation = glGetUniformLocation(barShader, "barSpacing");
+    barSizeLocation = glGetUniformLocation(barShader, "barSize");
+    glUseProgram(barShader);
+    glUniform1i(glGetUniformLocation(barShader, "valueTexture"), 0);
+    glUseProgram(0);
 
     // Initialize kiss fft
     fft_cfg = kiss_fftr_alloc(AudioAnalyzer::SAMPLE_SIZE, false, 0,0);
@@ -62,8 +71,19 @@ AudioAnalyzer::AudioAnalyzer() {
     setDefaultToggles();
 
     // Compute band mappings
+    sampleRate = SAMPLE_RATE;
     computeBandMappings();
 
+    if (!openInput) return;
+
+    // Initialize audio input, samples can still be set directly without it
+    PaError err = Pa_Initialize();
+    if (paErrorOccured(err)) {
+        return;
+    } else {
+        paInitSuccessful = true;
+    }
+
     // Attempt to open the default audio input device
     openDevice(0);
 }
@@ -82,6 +102,11 @@ void AudioAnalyzer::resetBuffers() {
         frequencyBands[i] = 0.0f;
     }
     volume = 0.0f;
+
+    std::vector<float> silence(NUM_BANDS * BAND_HISTORY_SIZE, 0.0f);
+    glBindTexture(GL_TEXTURE_2D, bandHistoryTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, NUM_BANDS, BAND_HISTORY_SIZE, GL_RED, GL_FLOAT, silence.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void AudioAnalyzer::setDefaultVariables() {
@@ -150,6 +175,12 @@ bool AudioAnalyzer::openDevice(int deviceIndex) {
 
     resetBuffers();
 
+    const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(deviceIndex);
+    if (deviceInfo == NULL) {
+        fprintf(stderr, "No audio input device %d\n", deviceIndex);
+        return false;
+    }
+
     int inputChannels = 2;
 
     memset(&inputParameters, 0, sizeof(inputParameters));
@@ -157,7 +188,7 @@ bool AudioAnalyzer::openDevice(int deviceIndex) {
     inputParameters.device = deviceIndex;
     inputParameters.hostApiSpecificStreamInfo = NULL;
     inputParameters.sampleFormat = paFloat32;
-    inputParameters.suggestedLatency = Pa_GetDeviceInfo(deviceIndex)->defaultLowInputLatency ;
+    inputParameters.suggestedLatency = deviceInfo->defaultLowInputLatency ;
 
     PaError err = Pa_OpenStream(
             &stream,
@@ -177,6 +208,29 @@ bool AudioAnalyzer::openDevice(int deviceIndex) {
     return true;
 }
 
+void AudioAnalyzer::setSamples(const float* samples) {
+    for (int i = 0; i < SAMPLE_SIZE; i++) {
+        rawAudio[i] = samples[i];
+    }
+}
+
+GLuint AudioAnalyzer::createFeatureTexture(int width, int height) {
+    std::vector<float> silence(width * height, 0.0f);
+
+    // Filtered so shaders can blend between neighbouring bins
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, silence.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
 void AudioAnalyzer::computeHanningWindow() {
     for (int i = 0; i < SAMPLE_SIZE; i++) {
         // hanningWindow[i] = (float) (0.5f * (1.0f - cos((2 * M_PI * i) / (SAMPLE_SIZE - 1))));
@@ -185,26 +239,42 @@ void AudioAnalyzer::computeHanningWindow() {
     }
 }
 
+void AudioAnalyzer::setSampleRate(int sampleRate) {
+    if (this->sampleRate == sampleRate) return;
+
+    this->sampleRate = sampleRate;
+    computeBandMappings();
+}
+
 void AudioAnalyzer::computeBandMappings() {
     float bandThresholds[NUM_BANDS];
     float sampleLinearThresholds[SAMPLE_SIZE / 2];
     float sampleLogThresholds[SAMPLE_SIZE / 2];
 
+    // The bands span the bins of a SAMPLE_RATE input, other rates place their bins by frequency within them
+    float binScale = sampleRate / (float) SAMPLE_RATE;
+
     for (int i = 0; i < NUM_BANDS; i++) {
         float pct = i / (float) NUM_BANDS;
         bandThresholds[i] = pct;
     }
 
     for (int i = 0; i < SAMPLE_SIZE / 2; i++) {
-        float pct = i / (float) (SAMPLE_SIZE / 2);
+        float pct = i * binScale / (float) (SAMPLE_SIZE / 2);
         sampleLinearThresholds[i] = pct;
     }
 
     for (int i = 0; i < SAMPLE_SIZE / 2; i++) {
-        float pct = log10f(i) / log10f(SAMPLE_SIZE / 2);
+        float pct = log10f(i * binScale) / log10f(SAMPLE_SIZE / 2);
         sampleLogThresholds[i] = pct;
     }
 
+    // Bins above the highest band are left out
+    for (int j = 0; j < SAMPLE_SIZE / 2; j++) {
+        linearMapping[j] = -1;
+        logMapping[j] = -1;
+    }
+
     std::vector<int> mappings[NUM_BANDS];
 
     for (int i = 0; i < NUM_BANDS; i++) {
@@ -277,7 +347,8 @@ void AudioAnalyzer::update() {
         processedAudio[i] *= frequencyDamping;
         processedAudio[i] = max(20.0f * log10f(magnitude), processedAudio[i]);
 
-        toBin[(logScaleBands ? logMapping : linearMapping)[i]] += magnitude * frequencyScale;
+        int band = (logScaleBands ? logMapping : linearMapping)[i];
+        if (band >= 0) toBin[band] += magnitude * frequencyScale;
     }
 
     float newVolume = 0.0f;
@@ -293,6 +364,25 @@ void AudioAnalyzer::update() {
     // Compute new overall volume level
     volume *= frequencyDamping;
     volume = max(newVolume, volume);
+
+    publishFeatureTextures();
+}
+
+void AudioAnalyzer::publishFeatureTextures() {
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindTexture(GL_TEXTURE_2D, spectrumTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SAMPLE_SIZE / 2, 1, GL_RED, GL_FLOAT, processedAudio);
+
+    glBindTexture(GL_TEXTURE_2D, bandTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, NUM_BANDS, 1, GL_RED, GL_FLOAT, frequencyBands);
+
+    // Only the newest row of the history changes, older rows are overwritten as the ring wraps
+    bandHistoryRow = (bandHistoryRow + 1) % BAND_HISTORY_SIZE;
+    glBindTexture(GL_TEXTURE_2D, bandHistoryTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, bandHistoryRow, NUM_BANDS, 1, GL_RED, GL_FLOAT, frequencyBands);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 float AudioAnalyzer::getFrequencyBand(int i) {
@@ -303,7 +393,28 @@ float AudioAnalyzer::getOverallVolume() {
     return volume;
 }
 
+GLuint AudioAnalyzer::getSpectrumTexture() {
+    return spectrumTexture;
+}
+
+GLuint AudioAnalyzer::getBandTexture() {
+    return bandTexture;
+}
+
+GLuint AudioAnalyzer::getBandHistoryTexture() {
+    return bandHistoryTexture;
+}
+
+int AudioAnalyzer::getBandHistoryRow() {
+    return bandHistoryRow;
+}
+
 void AudioAnalyzer::render(glm::mat4 transform) {
+    if (!displayWaveform && !displaySpectrum && !displayFrequencyBands && !displayVolumeLevel) return;
+
+    glBindVertexArray(overlayVertexArray);
+    fillOverlayBuffer();
+
     if (displayWaveform) renderWaveform(transform);
     if (displaySpectrum) {
         if (logScaleBands) renderLogSpectrum(transform);
@@ -311,91 +422,73 @@ void AudioAnalyzer::render(glm::mat4 transform) {
     }
     if (displayFrequencyBands) renderFrequencyBands(transform);
     if (displayVolumeLevel) renderVolumeLevel(transform);
+
+    glBindVertexArray(defaultVertexArray);
 }
 
-void AudioAnalyzer::renderWaveform(glm::mat4 transform) {
-    glUseProgram(shader);
+void AudioAnalyzer::fillOverlayBuffer() {
+    glBindBuffer(GL_ARRAY_BUFFER, overlayVBO);
 
-    float color[] = {1.0f, 0.0f, 0.0f, 0.0f};
-    setColor(shader, color);
+    // Invalidating the whole buffer lets the driver hand over fresh storage instead of waiting on last frame's draws
+    float *vertices = (float*) glMapBufferRange(GL_ARRAY_BUFFER, 0, OVERLAY_BUFFER_SIZE,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (vertices == NULL) return;
 
-    float waveformVertices[SAMPLE_SIZE * 2];
-
-    for (int i = 0; i < SAMPLE_SIZE; i++) {
-        waveformVertices[i*2] = i * spacing;
-        waveformVertices[i*2+1] = fft_in[i] * 350.0f + (SCREEN_HEIGHT * 0.5f);
+    for (int i = 0; i < WAVEFORM_VERTICES; i++) {
+        vertices[i*2] = i * spacing;
+        vertices[i*2+1] = fft_in[i] * 350.0f + (SCREEN_HEIGHT * 0.5f);
     }
 
-    GLint transformID = glGetUniformLocation(3, "MVP");
-    glUniformMatrix4fv(transformID, 1, GL_FALSE, &transform[0][0]);
-
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, waveformVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0.0f, sizeof(waveformVertices), waveformVertices);
-    glVertexAttribPointer(
-            0,         // shader layout attribute
-            2,         // size
-            GL_FLOAT,  // type
-            GL_FALSE,  // normalized?
-            0,         // stride
-            (void*)0   // array buffer offset
-    );
+    float *volumeVertices = vertices + WAVEFORM_VERTICES * 2;
+    float volumeQuad[] = {
+            0.0f, 0.0f,
+            volume * 25.0f, 0.0f,
+            0.0f, 100.0f,
+            volume * 25.0f, 100.0f,
+    };
+    for (int i = 0; i < VOLUME_VERTICES; i++) {
+        volumeVertices[i*2] = volumeQuad[i*2];
+        volumeVertices[i*2+1] = volumeQuad[i*2+1] + SCREEN_HEIGHT / 2.0f;
+    }
 
-    glDrawArrays(GL_LINE_STRIP, 0, SAMPLE_SIZE);
-    glDisableVertexAttribArray(0);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
 }
 
-void AudioAnalyzer::renderLinearSpectrum(glm::mat4 transform) {
+void AudioAnalyzer::renderWaveform(glm::mat4 transform) {
     glUseProgram(shader);
 
-    float color[] = {0.0f, 0.0f, 1.0f, 0.0f};
+    float color[] = {1.0f, 0.0f, 0.0f, 0.0f};
     setColor(shader, color);
 
-    for (int i = 0; i < SAMPLE_SIZE / 4; i++) {
-        glm::mat4 translate = glm::translate(glm::vec3(i * spacing * 4, 0.0f, 0.0f));
-        glm::mat4 scale = glm::scale(glm::vec3(spacing * 3, processedAudio[i] * 10.0f, 1.0f));
-        drawSquare(transform * translate * scale, true);
-    }
+    glUniformMatrix4fv(transformLocation, 1, GL_FALSE, &transform[0][0]);
+    glDrawArrays(GL_LINE_STRIP, 0, WAVEFORM_VERTICES);
 }
 
-void AudioAnalyzer::renderLogSpectrum(glm::mat4 transform) {
-    glUseProgram(shader);
+void AudioAnalyzer::renderLinearSpectrum(glm::mat4 transform) {
+    glUseProgram(barShader);
 
     float color[] = {0.0f, 0.0f, 1.0f, 0.0f};
-    setColor(shader, color);
+    setColor(barShader, color);
 
-    float logOver = log10f(SAMPLE_SIZE / 2);
-
-    for (int i = 0; i < SAMPLE_SIZE / 2; i++) {
-        float pct = i / (float) (SAMPLE_SIZE / 2);
-
-        float x = pct * SCREEN_WIDTH;
-        // x = log10f(i) / logOver * SCREEN_WIDTH;
+    drawBars(transform, spectrumTexture, FETCH_VALUE, SAMPLE_SIZE / 4, glm::vec2(0.0f), spacing * 4, glm::vec2(spacing * 3, 10.0f));
+}
 
-        float fIndex = (powf(10, pct * logOver));
-        int minIndex = (int) max(fIndex, 0.0f);
-        int maxIndex = (int) min(fIndex + 1.0f, SAMPLE_SIZE / 2 - 1.0f);
+void AudioAnalyzer::renderLogSpectrum(glm::mat4 transform) {
+    glUseProgram(barShader);
 
-        float value = lerp(processedAudio[minIndex], processedAudio[maxIndex], fIndex - minIndex);
-        // value = processedAudio[i];
+    float color[] = {0.0f, 0.0f, 1.0f, 0.0f};
+    setColor(barShader, color);
 
-        glm::mat4 translate = glm::translate(glm::vec3(x, 0.0f, 0.0f)); // i * spacing * 4
-        glm::mat4 scale = glm::scale(glm::vec3(spacing * 1.5f, value * 10.0f, 1.0f));
-        drawSquare(transform * translate * scale, true);
-    }
+    drawBars(transform, spectrumTexture, LOG_SPECTRUM, SAMPLE_SIZE / 2, glm::vec2(0.0f), spacing * 2, glm::vec2(spacing * 1.5f, 10.0f));
 }
 
 void AudioAnalyzer::renderFrequencyBands(glm::mat4 transform) {
-    glUseProgram(shader);
+    glUseProgram(barShader);
 
     float color[] = {0.0f, 1.0f, 0.0f, 0.0f};
-    setColor(shader, color);
+    setColor(barShader, color);
 
-    for (int i = 0; i < NUM_BANDS; i++) {
-        glm::mat4 translate = glm::translate(glm::vec3(i * bandSpacing, SCREEN_HEIGHT, 0.0f));
-        glm::mat4 scale = glm::scale(glm::vec3(bandSpacing * 0.75f, frequencyBands[i] * -10.0f, 1.0f));
-        drawSquare(transform * translate * scale, true);
-    }
+    drawBars(transform, bandTexture, FETCH_VALUE, NUM_BANDS, glm::vec2(0.0f, SCREEN_HEIGHT), bandSpacing, glm::vec2(bandSpacing * 0.75f, -10.0f));
 }
 
 void AudioAnalyzer::renderVolumeLevel(glm::mat4 transform) {
@@ -404,32 +497,24 @@ void AudioAnalyzer::renderVolumeLevel(glm::mat4 transform) {
     float color[] = {0.0f, 1.0f, 1.0f, 0.0f};
     setColor(shader, color);
 
-    glm::mat4 translate = glm::translate(glm::vec3(0, SCREEN_HEIGHT / 2.0f, 0.0f));
-    glm::mat4 scale = glm::scale(glm::vec3(volume * 25.0f, 100.0f, 1.0f));
-    drawSquare(transform * translate * scale, true);
+    glUniformMatrix4fv(transformLocation, 1, GL_FALSE, &transform[0][0]);
+    glDrawArrays(GL_TRIANGLE_STRIP, WAVEFORM_VERTICES, VOLUME_VERTICES);
 }
 
-void AudioAnalyzer::drawSquare(glm::mat4 transform, bool fill) {
-    GLint transformID = glGetUniformLocation(3, "MVP");
-    glUniformMatrix4fv(transformID, 1, GL_FALSE, &transform[0][0]);
+void AudioAnalyzer::drawBars(glm::mat4 transform, GLuint values, BarValueSource source, int numBars, glm::vec2 origin, float spacing, glm::vec2 size) {
+    glUniformMatrix4fv(barTransformLocation, 1, GL_FALSE, &transform[0][0]);
+    glUniform1i(valueSourceLocation, source);
+    glUniform2fv(originLocation, 1, &origin[0]);
+    glUniform1f(barSpacingLocation, spacing);
+    glUniform2fv(barSizeLocation, 1, &size[0]);
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, squareVBO);
-    glVertexAttribPointer(
-            0,         // shader layout attribute
-            2,         // size
-            GL_FLOAT,  // type
-            GL_FALSE,  // normalized?
-            0,         // stride
-            (void*)0   // array buffer offset
-    );
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, values);
 
-    if (fill) {
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    } else {
-        glDrawArrays(GL_LINE_LOOP, 0, 4);
-    }
-    glDisableVertexAttribArray(0);
+    // Every bar is one instance of a four vertex strip
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numBars);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void AudioAnalyzer::printAudioDevices() {
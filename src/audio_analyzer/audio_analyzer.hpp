@@ -13,14 +13,15 @@ public:
     static constexpr int SAMPLE_RATE = 44100;
     static constexpr int SAMPLE_SIZE = 2048;
     static constexpr int NUM_BANDS = 24;
+    static constexpr int BAND_HISTORY_SIZE = 128;
 
     // Variables
     float frequencyDamping;
     float frequencyScale;
     float volumeScale;
 
-    // Setup
-    AudioAnalyzer();
+    // Setup, without the live input the samples are only set directly
+    AudioAnalyzer(bool openInput = true);
     void setDefaultVariables();
     void setDefaultToggles();
     void resetBuffers();
@@ -31,6 +32,12 @@ public:
     bool openDevice(int deviceIndex);
     void printAudioDevices();
 
+    // Replace the analysed samples with SAMPLE_SIZE mono samples, e.g: from a file instead of a device
+    void setSamples(const float* samples);
+
+    // Rate of the set samples, the bands keep to the same frequencies at any rate
+    void setSampleRate(int sampleRate);
+
     // Updating
     void update();
 
@@ -38,6 +45,12 @@ public:
     float getFrequencyBand(int i);
     float getOverallVolume();
 
+    // Feature textures, rewritten one row at a time each update for shaders to sample
+    GLuint getSpectrumTexture();
+    GLuint getBandTexture();
+    GLuint getBandHistoryTexture();
+    int getBandHistoryRow();
+
     // Rendering
     void render(glm::mat4 transform);
 
@@ -51,12 +64,28 @@ public:
 
 private:
 
-    // Vertex buffer objects
-    GLuint waveformVBO;
-    GLuint squareVBO;
+    // Overlay vertex buffer, refilled every frame with the waveform and the volume bar
+    static constexpr int WAVEFORM_VERTICES = SAMPLE_SIZE;
+    static constexpr int VOLUME_VERTICES = 4;
+    static constexpr GLsizeiptr OVERLAY_BUFFER_SIZE = (WAVEFORM_VERTICES + VOLUME_VERTICES) * 2 * sizeof(float);
+    GLuint overlayVBO;
+
+    // Vertex array objects, the application's own is restored after rendering
+    GLuint defaultVertexArray;
+    GLuint overlayVertexArray;
+
+    // Feature textures, the band history is a ring of one row per update
+    GLuint spectrumTexture;
+    GLuint bandTexture;
+    GLuint bandHistoryTexture;
+    int bandHistoryRow;
 
     // Shaders
+    enum BarValueSource { FETCH_VALUE, LOG_SPECTRUM };
     GLuint shader;
+    GLuint barShader;
+    GLint transformLocation;
+    GLint barTransformLocation, valueSourceLocation, originLocation, barSpacingLocation, barSizeLocation;
 
     // Instance variables
     float spacing;
@@ -70,6 +99,7 @@ private:
     // Audio data variables
     float processedAudio[AudioAnalyzer::SAMPLE_SIZE / 2];
     float frequencyBands[AudioAnalyzer::NUM_BANDS];
+    int sampleRate;
     int linearMapping[SAMPLE_SIZE / 2];
     int logMapping[SAMPLE_SIZE / 2];
     float volume;
@@ -82,6 +112,10 @@ private:
     // Setup
     void computeHanningWindow();
     void computeBandMappings();
+    GLuint createFeatureTexture(int width, int height);
+
+    // Publishing
+    void publishFeatureTextures();
 
     // Error handling
     bool paErrorOccured(PaError error);
@@ -92,7 +126,8 @@ private:
     void renderLogSpectrum(glm::mat4);
     void renderFrequencyBands(glm::mat4);
     void renderVolumeLevel(glm::mat4);
-    void drawSquare(glm::mat4, bool);
+    void fillOverlayBuffer();
+    void drawBars(glm::mat4 transform, GLuint values, BarValueSource source, int numBars, glm::vec2 origin, float spacing, glm::vec2 size);
 
 };
 
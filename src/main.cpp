@@ -1,4 +1,6 @@
 #include <iostream>
+#include <chrono>
+#include <cstring>
 #include <main.hpp>
 #include <opengl.hpp>
 #include <imgui.h>
@@ -7,6 +9,12 @@
 #include <smoke_simulation/smoke_simulation_gui.hpp>
 #include <audio_analyzer/audio_analyzer_gui.hpp>
 #include <manager_gui.hpp>
+#include <offline_renderer/offline_renderer.hpp>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 // Main window reference
 GLFWwindow* window;
@@ -59,8 +67,171 @@ void keyCallback(GLFWwindow *win, int key, int scancode, int action, int mods) {
     }
 }
 
+#ifdef __linux__
+
+// Headless context and the offscreen framebuffer standing in for the window
+EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+EGLContext headlessContext = EGL_NO_CONTEXT;
+GLuint offscreenVertexArray, offscreenColorBuffer, offscreenFramebuffer;
+
+#endif
+
+bool createHeadlessContext() {
+#ifdef __linux__
+
+    // Prefer the surfaceless platform, it needs neither a display server nor a window
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL) {
+        headlessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (headlessDisplay == EGL_NO_DISPLAY) {
+        headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, NULL, NULL)) {
+        fprintf(stderr, "Failed to initialize EGL\n");
+        return false;
+    }
+
+    // Create an OpenGL 3.3 core context that is made current without any surface
+    EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint numConfigs;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(headlessDisplay, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+        fprintf(stderr, "Failed to find an EGL config\n");
+        eglTerminate(headlessDisplay);
+        return false;
+    }
+
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    headlessContext = eglCreateContext(headlessDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (headlessContext == EGL_NO_CONTEXT || !eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext)) {
+        fprintf(stderr, "Failed to create a surfaceless EGL context\n");
+        eglTerminate(headlessDisplay);
+        return false;
+    }
+
+    // Initialize GLEW
+    glewExperimental = 1; // Needed in core profile
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        eglTerminate(headlessDisplay);
+        return false;
+    }
+
+    // Setup the vertex array object
+    glGenVertexArrays(1, &offscreenVertexArray);
+    glBindVertexArray(offscreenVertexArray);
+
+    // Render into an offscreen framebuffer of the screen size instead of a window
+    glGenRenderbuffers(1, &offscreenColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    glGenFramebuffers(1, &offscreenFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColorBuffer);
+    glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    return true;
+#else
+    fprintf(stderr, "Headless and offline modes need EGL and are only available on Linux\n");
+    return false;
+#endif
+}
+
+void destroyHeadlessContext() {
+#ifdef __linux__
+    glDeleteFramebuffers(1, &offscreenFramebuffer);
+    glDeleteRenderbuffers(1, &offscreenColorBuffer);
+    glDeleteVertexArrays(1, &offscreenVertexArray);
+
+    eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(headlessDisplay, headlessContext);
+    eglTerminate(headlessDisplay);
+#endif
+}
+
+int runHeadless(int frames) {
+    if (!createHeadlessContext()) return -1;
+
+    printf("\n~~~\n\n");
+
+    // Setup the component manager, it keeps drawing into the offscreen framebuffer
+    manager = new Manager();
+
+    printf("\n~~~\n\n");
+
+    // Update as fast as possible, there is no vsync or buffer swap to wait on
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last = start;
+    frameCount = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        manager->update(false, mousePosition);
+        frameCount++;
+
+        // Print the frame time every second
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - last).count() >= 1.0) {
+            if (manager->printFrameTimes) printf("%f ms/frame\n", 1000.0 / (double) frameCount);
+            frameCount = 0;
+            last = now;
+        }
+    }
+
+    // Include the queued GPU work of the last frames
+    glFinish();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%d frames in %f ms, %f ms/frame\n", frames, elapsed, frames > 0 ? elapsed / frames : 0.0);
+
+    delete manager;
+
+    destroyHeadlessContext();
+
+    return 0;
+}
+
+int runOffline(std::string audioPath, std::string outputPath, int framesPerSecond, unsigned int seed) {
+    if (!createHeadlessContext()) return -1;
+
+    OfflineRenderer renderer(audioPath, outputPath, framesPerSecond, seed);
+    bool rendered = renderer.run();
+
+    destroyHeadlessContext();
+
+    return rendered ? 0 : -1;
+}
+
 int main(int argc, char **argv) {
 
+    for (int i = 1; i < argc; i++) {
+
+        // Run without a window for a number of frames, e.g: benchmarks on a headless machine
+        if (strcmp(argv[i], "--headless") == 0) {
+            return runHeadless(i + 1 < argc ? atoi(argv[i + 1]) : HEADLESS_FRAMES);
+        }
+
+        // Render an audio file to a frame sequence as fast as possible
+        if (strcmp(argv[i], "--offline") == 0) {
+            if (i + 2 >= argc) {
+                fprintf(stderr, "Usage: --offline <audio.wav> <output.y4m | output.rgb | frames/%%05d.png> [fps] [seed]\n");
+                return -1;
+            }
+
+            int framesPerSecond = i + 3 < argc ? atoi(argv[i + 3]) : OfflineRenderer::DEFAULT_FRAMES_PER_SECOND;
+            unsigned int seed = i + 4 < argc ? (unsigned int) strtoul(argv[i + 4], NULL, 10) : OfflineRenderer::DEFAULT_SEED;
+            return runOffline(argv[i + 1], argv[i + 2], framesPerSecond, seed);
+        }
+    }
+
     // Initialise GLFW
     if(!glfwInit()) {
         fprintf(stderr, "Failed to initialize GLFW\n");
@@ -9,6 +9,9 @@
 #define BORDERLESS false
 #define VSYNC true
 
+// Frames updated by a headless run unless a count is given
+#define HEADLESS_FRAMES 600
+
 #if FULL_SCREEN || BORDERLESS
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1080
@@ -2,16 +2,17 @@
 // Created by Jack Purvis
 //
 
+#include <algorithm>
 #include <manager.hpp>
 #include <compositions/horizontal_spectrum.hpp>
 #include <compositions/circular_spectrum.hpp>
 #include <compositions/rgb_spectrum.hpp>
 
-Manager::Manager() {
+Manager::Manager(bool openAudioInput) {
 
     // Setup object instances
     smokeSimulation = new SmokeSimulation();
-    audioAnalyzer = new AudioAnalyzer();
+    audioAnalyzer = new AudioAnalyzer(openAudioInput);
 
     // Setup compositions
     currentComposition = 0;
@@ -27,6 +28,11 @@ Manager::Manager() {
     // Setup toggles
     enableCompositions = true;
     printFrameTimes = false;
+    enableFixedRate = false;
+    simulationRate = 60.0f;
+
+    lastFrameTime = std::chrono::steady_clock::now();
+    pendingSteps = 0.0;
 }
 
 Manager::~Manager() {
@@ -40,25 +46,50 @@ Manager::~Manager() {
 }
 
 void Manager::update(bool mouseDragging, glm::vec2 mousePosition) {
-    if (enableCompositions) {
-        compositions[currentComposition]->update();
-    }
+    int steps = stepsDue();
 
-    if (mouseDragging) smokeSimulation->addPulse(mousePosition);
+    for (int step = 0; step < steps; step++) {
+        if (enableCompositions) {
+            compositions[currentComposition]->update();
+        }
 
-    smokeSimulation->update();
+        if (mouseDragging) smokeSimulation->addPulse(mousePosition);
+
+        smokeSimulation->update();
+    }
 
     glm::mat4 projection = glm::ortho(0.0f, (float) SCREEN_WIDTH, (float) SCREEN_HEIGHT, 0.0f);
     glm::mat4 view = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
     glm::mat4 mvp = projection * view;
 
-    smokeSimulation->render(mvp, mousePosition);
+    // Shaders see the audio features of the last analyzer update, as the compositions do
+    smokeSimulation->setAudioTextures(audioAnalyzer->getSpectrumTexture(), audioAnalyzer->getBandTexture(),
+                                      audioAnalyzer->getBandHistoryTexture(), audioAnalyzer->getBandHistoryRow());
+    smokeSimulation->render(mvp, mousePosition, enableFixedRate ? (float) pendingSteps : 0.0f);
 
     audioAnalyzer->update();
 
     audioAnalyzer->render(mvp);
 }
 
+int Manager::stepsDue() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - lastFrameTime).count();
+    lastFrameTime = now;
+
+    if (!enableFixedRate) {
+        pendingSteps = 0.0;
+        return 1;
+    }
+
+    // Whole steps are run now, the remainder is how far the display is ahead of the last one
+    pendingSteps += elapsed * simulationRate;
+    int steps = (int) pendingSteps;
+    pendingSteps -= steps;
+
+    return std::min(steps, MAX_STEPS_PER_FRAME);
+}
+
 void Manager::setComposition(int composition) {
     currentComposition = composition;
     compositions[currentComposition]->enable();
@@ -5,6 +5,7 @@
 #ifndef SMOKEYBBQ_MANAGER_HPP
 #define SMOKEYBBQ_MANAGER_HPP
 
+#include <chrono>
 #include <smoke_simulation/smoke_simulation.hpp>
 #include <audio_analyzer/audio_analyzer.hpp>
 #include <compositions/composition.hpp>
@@ -19,6 +20,10 @@ public:
     // Toggle variables
     bool enableCompositions;
     bool printFrameTimes;
+    bool enableFixedRate;
+
+    // Simulation steps per second while the fixed rate is enabled, frames in between are interpolated
+    float simulationRate;
 
     // Components
     SmokeSimulation* smokeSimulation;
@@ -27,8 +32,8 @@ public:
     // Compositions
     std::vector<Composition*> compositions;
 
-    // Setup
-    Manager();
+    // Setup, offline runs leave the live audio input closed
+    Manager(bool openAudioInput = true);
     ~Manager();
 
     // Core
@@ -36,6 +41,16 @@ public:
     void setComposition(int composition);
     void resetComponents();
 
+private:
+
+    // Steps the simulation may run in one frame before it falls behind instead
+    static constexpr int MAX_STEPS_PER_FRAME = 4;
+
+    // Fixed rate stepping
+    std::chrono::steady_clock::time_point lastFrameTime;
+    double pendingSteps;
+    int stepsDue();
+
 };
 
 #endif //SMOKEYBBQ_MANAGER_HPP
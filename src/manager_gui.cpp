@@ -24,6 +24,10 @@ void ManagerGui::render() {
 void ManagerGui::renderToggles() {
     ImGui::Checkbox("Enable Compositions", &manager->enableCompositions);
     ImGui::Checkbox("Print Frame Times", &manager->printFrameTimes);
+    ImGui::Checkbox("Fixed Simulation Rate", &manager->enableFixedRate);
+    if (manager->enableFixedRate) {
+        ImGui::SliderFloat("##simulationRate", &manager->simulationRate, 15.0f, 120.0f, "%.0f steps/s");
+    }
 
     ImGui::Separator(); // Reset toggles
 
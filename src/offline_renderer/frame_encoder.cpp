@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <offline_renderer/frame_encoder.hpp>
+
+std::string y4mHeader(int width, int height, int framesPerSecond) {
+    return "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+           " F" + std::to_string(framesPerSecond) + ":1 Ip A1:1 C444\n";
+}
+
+std::vector<unsigned char> encodeY4MFrame(const std::vector<unsigned char> &rgba, int width, int height) {
+    static const char FRAME_HEADER[] = "FRAME\n";
+    size_t headerSize = sizeof(FRAME_HEADER) - 1;
+    size_t planeSize = (size_t) width * height;
+
+    std::vector<unsigned char> frame(headerSize + planeSize * 3);
+    std::copy(FRAME_HEADER, FRAME_HEADER + headerSize, frame.begin());
+
+    unsigned char* yPlane = &frame[headerSize];
+    unsigned char* uPlane = yPlane + planeSize;
+    unsigned char* vPlane = uPlane + planeSize;
+
+    // Studio range BT.601 in fixed point
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = &rgba[(size_t) (height - 1 - y) * width * 4];
+
+        for (int x = 0; x < width; x++) {
+            int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+            size_t i = (size_t) y * width + x;
+
+            yPlane[i] = (unsigned char) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            uPlane[i] = (unsigned char) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vPlane[i] = (unsigned char) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    return frame;
+}
+
+std::vector<unsigned char> encodeRawFrame(const std::vector<unsigned char> &rgba, int width, int height) {
+    std::vector<unsigned char> frame((size_t) width * height * 3);
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = &rgba[(size_t) (height - 1 - y) * width * 4];
+        unsigned char* destination = &frame[(size_t) y * width * 3];
+
+        for (int x = 0; x < width; x++) {
+            destination[x * 3] = row[x * 4];
+            destination[x * 3 + 1] = row[x * 4 + 1];
+            destination[x * 3 + 2] = row[x * 4 + 2];
+        }
+    }
+
+    return frame;
+}
+
+static std::vector<unsigned int> crcTable() {
+    std::vector<unsigned int> table(256);
+
+    for (unsigned int n = 0; n < 256; n++) {
+        unsigned int c = n;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+
+    return table;
+}
+
+static unsigned int crc32(const unsigned char* bytes, size_t length) {
+
+    // Built on first use, static initialisation is thread safe so encoding workers can share it
+    static const std::vector<unsigned int> table = crcTable();
+
+    unsigned int crc = ~0u;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<unsigned char> &bytes, unsigned int value) {
+    bytes.push_back((unsigned char) (value >> 24));
+    bytes.push_back((unsigned char) (value >> 16));
+    bytes.push_back((unsigned char) (value >> 8));
+    bytes.push_back((unsigned char) value);
+}
+
+static void appendChunk(std::vector<unsigned char> &png, const char* type, const std::vector<unsigned char> &data) {
+    appendBigEndian(png, (unsigned int) data.size());
+
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+
+    appendBigEndian(png, crc32(&png[start], png.size() - start));
+}
+
+std::vector<unsigned char> encodePNG(const std::vector<unsigned char> &rgba, int width, int height) {
+    static const unsigned char SIGNATURE[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    static const size_t MAX_STORED_BLOCK = 65535;
+
+    // Each scanline starts with its filter type, none
+    size_t rowSize = (size_t) width * 3;
+    std::vector<unsigned char> scanlines((rowSize + 1) * height);
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = &rgba[(size_t) (height - 1 - y) * width * 4];
+        unsigned char* destination = &scanlines[y * (rowSize + 1)];
+
+        destination[0] = 0;
+        for (int x = 0; x < width; x++) {
+            destination[1 + x * 3] = row[x * 4];
+            destination[1 + x * 3 + 1] = row[x * 4 + 1];
+            destination[1 + x * 3 + 2] = row[x * 4 + 2];
+        }
+    }
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.push_back(8); // bit depth
+    header.push_back(2); // RGB
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // not interlaced
+
+    // Zlib stream of stored deflate blocks
+    std::vector<unsigned char> data = { 0x78, 0x01 };
+    unsigned int a = 1, b = 0;
+
+    for (size_t offset = 0; offset < scanlines.size(); offset += MAX_STORED_BLOCK) {
+        size_t length = std::min(MAX_STORED_BLOCK, scanlines.size() - offset);
+        bool last = offset + length == scanlines.size();
+
+        data.push_back(last ? 1 : 0);
+        data.push_back((unsigned char) length);
+        data.push_back((unsigned char) (length >> 8));
+        data.push_back((unsigned char) ~length);
+        data.push_back((unsigned char) (~length >> 8));
+        data.insert(data.end(), scanlines.begin() + offset, scanlines.begin() + offset + length);
+
+        for (size_t i = offset; i < offset + length; i++) {
+            a = (a + scanlines[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    appendBigEndian(data, (b << 16) | a);
+
+    std::vector<unsigned char> png(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", data);
+    appendChunk(png, "IEND", std::vector<unsigned char>());
+
+    return png;
+}
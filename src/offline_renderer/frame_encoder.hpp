@@ -0,0 +1,19 @@
+#ifndef SMOKEYBBQ_FRAME_ENCODER_HPP
+#define SMOKEYBBQ_FRAME_ENCODER_HPP
+
+#include <string>
+#include <vector>
+
+// Frames are RGBA rows read back bottom up from GL, the encoders write them top down
+
+// YUV4MPEG2 stream of full resolution 4:4:4 BT.601 frames
+std::string y4mHeader(int width, int height, int framesPerSecond);
+std::vector<unsigned char> encodeY4MFrame(const std::vector<unsigned char> &rgba, int width, int height);
+
+// Headerless 8 bit RGB frames
+std::vector<unsigned char> encodeRawFrame(const std::vector<unsigned char> &rgba, int width, int height);
+
+// RGB PNG image, stored without compression so encoding never dominates the frame time
+std::vector<unsigned char> encodePNG(const std::vector<unsigned char> &rgba, int width, int height);
+
+#endif //SMOKEYBBQ_FRAME_ENCODER_HPP
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
+#include <threadPool.hpp>
+#include <manager.hpp>
+#include <offline_renderer/offline_renderer.hpp>
+#include <offline_renderer/frame_encoder.hpp>
+
+OfflineRenderer::OfflineRenderer(std::string audioPath, std::string outputPath, int framesPerSecond, unsigned int seed) :
+        audioPath(audioPath), outputPath(outputPath), framesPerSecond(framesPerSecond), seed(seed),
+        imageWriteFailed(false), frameNumberWidth(0) {
+    window.resize(AudioAnalyzer::SAMPLE_SIZE);
+}
+
+bool OfflineRenderer::run() {
+    if (framesPerSecond <= 0) {
+        fprintf(stderr, "Frame rate must be positive\n");
+        return false;
+    }
+
+    if (!chooseFormat() || !loadWavFile(audioPath, wav) || !openOutput()) return false;
+
+    // Every frame of the audio, the last one may only be partly covered
+    int numFrames = (int) (((long long) wav.samples.size() * framesPerSecond + wav.sampleRate - 1) / wav.sampleRate);
+
+    // Frames are read from the framebuffer the caller bound, which the simulation also draws into
+    GLint boundFramebuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &boundFramebuffer);
+    framebuffer = (GLuint) boundFramebuffer;
+
+    glGenBuffers(READBACK_RING_SIZE, readbackBuffers);
+    for (int i = 0; i < READBACK_RING_SIZE; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, SCREEN_WIDTH * SCREEN_HEIGHT * 4, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // The emitter and pulses draw from std::rand, seed it before anything is simulated
+    std::srand(seed);
+
+    // The file replaces the live input, and every update is exactly one simulation step
+    Manager* manager = new Manager(false);
+    manager->audioAnalyzer->setSampleRate(wav.sampleRate);
+    manager->enableFixedRate = false;
+
+    int numThreads = std::max((int) std::thread::hardware_concurrency() - 1, 1);
+    ThreadPool encoders(numThreads);
+    std::deque<std::future<std::vector<unsigned char>>> encodedFrames;
+
+    printf("Rendering %d frames at %d fps to %s\n", numFrames, framesPerSecond, outputPath.c_str());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastReport = start;
+
+    // The frame READBACK_RING_SIZE - 1 behind the current one is collected while the GPU works on the current one
+    for (int frame = 0; frame < numFrames + READBACK_RING_SIZE - 1; frame++) {
+        if (frame < numFrames) {
+            feedAudio(manager->audioAnalyzer, frame);
+
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            manager->update(false, glm::vec2(0.0f, 0.0f));
+
+            queueReadback(frame);
+        }
+
+        int readyFrame = frame - (READBACK_RING_SIZE - 1);
+        if (readyFrame >= 0) {
+            std::shared_ptr<std::vector<unsigned char>> pixels = std::make_shared<std::vector<unsigned char>>(collectReadback(readyFrame));
+
+            encodedFrames.push_back(encoders.submit<std::vector<unsigned char>>([this, pixels, readyFrame]() {
+                return encodeFrame(*pixels, readyFrame);
+            }));
+        }
+
+        // Write encoded frames in order, waiting on the oldest once too many are queued
+        while (!encodedFrames.empty() &&
+               (encodedFrames.size() > MAX_FRAMES_IN_FLIGHT || frame >= numFrames ||
+                encodedFrames.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+            std::vector<unsigned char> encoded = encodedFrames.front().get();
+            encodedFrames.pop_front();
+
+            if (stream.is_open()) stream.write((const char*) encoded.data(), encoded.size());
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastReport).count() >= 1.0) {
+            printf("%d / %d frames\n", std::min(frame + 1, numFrames), numFrames);
+            lastReport = now;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Rendered %d frames in %f s, %f fps\n", numFrames, elapsed, elapsed > 0.0 ? numFrames / elapsed : 0.0);
+
+    delete manager;
+
+    glDeleteBuffers(READBACK_RING_SIZE, readbackBuffers);
+
+    bool written = !stream.is_open() || stream.good();
+    if (stream.is_open()) stream.close();
+    if (!written) fprintf(stderr, "Failed to write %s\n", outputPath.c_str());
+
+    // Each failed image was reported by its encoder
+    return written && !imageWriteFailed;
+}
+
+bool OfflineRenderer::chooseFormat() {
+    std::string extension = outputPath.size() >= 4 ? outputPath.substr(outputPath.size() - 4) : "";
+
+    if (extension == ".y4m") {
+        format = Y4M;
+    } else if (extension == ".rgb") {
+        format = RAW_RGB;
+    } else if (outputPath.find('%') != std::string::npos) {
+        format = PNG_SEQUENCE;
+        return parseFramePattern();
+    } else {
+        fprintf(stderr, "Output must be a .y4m or .rgb file or a frame pattern such as frames/%%05d.png\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool OfflineRenderer::parseFramePattern() {
+    size_t start = outputPath.find('%');
+
+    // An optional zero padded width, then the conversion
+    size_t end = start + 1;
+    bool zeroPadded = end < outputPath.size() && outputPath[end] == '0';
+    if (zeroPadded) end++;
+
+    size_t digits = end;
+    while (end < outputPath.size() && end - digits < 3 && outputPath[end] >= '0' && outputPath[end] <= '9') end++;
+
+    bool valid = end < outputPath.size() && outputPath[end] == 'd' && zeroPadded == (end > digits) &&
+                 outputPath.find('%', end) == std::string::npos;
+    if (!valid) {
+        fprintf(stderr, "Frame pattern must contain exactly one %%d or %%0Nd and no other %%, such as frames/%%05d.png\n");
+        return false;
+    }
+
+    imagePathPrefix = outputPath.substr(0, start);
+    imagePathSuffix = outputPath.substr(end + 1);
+    frameNumberWidth = end > digits ? atoi(outputPath.substr(digits, end - digits).c_str()) : 0;
+
+    return true;
+}
+
+bool OfflineRenderer::openOutput() {
+
+    // Each image of a sequence is written by its encoder
+    if (format == PNG_SEQUENCE) return true;
+
+    stream.open(outputPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+        fprintf(stderr, "Failed to open %s\n", outputPath.c_str());
+        return false;
+    }
+
+    if (format == Y4M) stream << y4mHeader(SCREEN_WIDTH, SCREEN_HEIGHT, framesPerSecond);
+
+    return true;
+}
+
+void OfflineRenderer::feedAudio(AudioAnalyzer* audioAnalyzer, int frame) {
+
+    // The window ends at the frame's end in whole samples, computed from the frame number so hops never drift.
+    // The analysis reaches the display on the next frame, as it does for the live input.
+    long long end = ((long long) frame + 1) * wav.sampleRate / framesPerSecond;
+
+    for (int i = 0; i < AudioAnalyzer::SAMPLE_SIZE; i++) {
+        long long sample = end - AudioAnalyzer::SAMPLE_SIZE + i;
+        window[i] = sample >= 0 && sample < (long long) wav.samples.size() ? wav.samples[sample] : 0.0f;
+    }
+
+    audioAnalyzer->setSamples(window.data());
+}
+
+void OfflineRenderer::queueReadback(int frame) {
+
+    // Reading into a pixel buffer returns immediately, the copy completes alongside later frames
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[frame % READBACK_RING_SIZE]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, (void*) 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+std::vector<unsigned char> OfflineRenderer::collectReadback(int frame) {
+    std::vector<unsigned char> pixels(SCREEN_WIDTH * SCREEN_HEIGHT * 4, 0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[frame % READBACK_RING_SIZE]);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels.size(), GL_MAP_READ_BIT);
+    if (mapped != NULL) {
+        memcpy(pixels.data(), mapped, pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return pixels;
+}
+
+std::vector<unsigned char> OfflineRenderer::encodeFrame(const std::vector<unsigned char> &pixels, int frame) {
+    if (format == Y4M) return encodeY4MFrame(pixels, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (format == RAW_RGB) return encodeRawFrame(pixels, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    std::vector<unsigned char> png = encodePNG(pixels, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    std::string path = imagePath(frame);
+
+    std::ofstream image(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    image.write((const char*) png.data(), png.size());
+    if (!image.good()) {
+        fprintf(stderr, "Failed to write %s\n", path.c_str());
+        imageWriteFailed = true;
+    }
+
+    // Nothing is left for the ordered stream
+    return std::vector<unsigned char>();
+}
+
+std::string OfflineRenderer::imagePath(int frame) {
+    std::string number = std::to_string(frame);
+    if ((int) number.size() < frameNumberWidth) number.insert(0, frameNumberWidth - number.size(), '0');
+
+    return imagePathPrefix + number + imagePathSuffix;
+}
@@ -0,0 +1,83 @@
+#ifndef SMOKEYBBQ_OFFLINE_RENDERER_HPP
+#define SMOKEYBBQ_OFFLINE_RENDERER_HPP
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <opengl.hpp>
+#include <audio_analyzer/audio_analyzer.hpp>
+#include <offline_renderer/wav_file.hpp>
+
+// Renders the visualisation of an audio file frame by frame, as fast as the machine allows.
+// The same file, frame rate and seed always produce the same frames.
+class OfflineRenderer {
+
+public:
+
+    // Constants
+    static constexpr int DEFAULT_FRAMES_PER_SECOND = 60;
+    static constexpr unsigned int DEFAULT_SEED = 0;
+
+    // Frames read back asynchronously before the oldest is collected
+    static constexpr int READBACK_RING_SIZE = 3;
+
+    // Frames handed to the encoders before the renderer waits for the oldest to be written
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 8;
+
+    // Output formats, chosen by the output path
+    enum OutputFormat {
+        Y4M,          // *.y4m
+        RAW_RGB,      // *.rgb
+        PNG_SEQUENCE  // path with one %d or %0Nd for the frame number, e.g: frames/%05d.png
+    };
+
+    // Setup
+    OfflineRenderer(std::string audioPath, std::string outputPath, int framesPerSecond, unsigned int seed);
+
+    // Renders every frame of the audio file into the bound framebuffer, the GL context must be current
+    bool run();
+
+private:
+
+    // Settings
+    std::string audioPath;
+    std::string outputPath;
+    int framesPerSecond;
+    unsigned int seed;
+    OutputFormat format;
+
+    // Audio
+    WavFile wav;
+    std::vector<float> window;
+
+    // Readback
+    GLuint framebuffer;
+    GLuint readbackBuffers[READBACK_RING_SIZE];
+
+    // Output
+    std::ofstream stream;
+    std::atomic<bool> imageWriteFailed;
+
+    // Image sequence paths, the frame number zero padded to the width goes between the prefix and suffix
+    std::string imagePathPrefix;
+    std::string imagePathSuffix;
+    int frameNumberWidth;
+
+    // Setup
+    bool chooseFormat();
+    bool parseFramePattern();
+    bool openOutput();
+
+    // Rendering
+    void feedAudio(AudioAnalyzer* audioAnalyzer, int frame);
+    void queueReadback(int frame);
+    std::vector<unsigned char> collectReadback(int frame);
+
+    // Encoding, runs on the worker threads
+    std::vector<unsigned char> encodeFrame(const std::vector<unsigned char> &pixels, int frame);
+    std::string imagePath(int frame);
+
+};
+
+#endif //SMOKEYBBQ_OFFLINE_RENDERER_HPP
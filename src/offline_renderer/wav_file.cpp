@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <offline_renderer/wav_file.hpp>
+
+static const int FORMAT_PCM = 1;
+static const int FORMAT_FLOAT = 3;
+static const int FORMAT_EXTENSIBLE = 0xFFFE;
+
+// WAV fields are little endian regardless of the host
+static unsigned int readLittleEndian(const unsigned char* bytes, int numBytes) {
+    unsigned int value = 0;
+    for (int i = numBytes - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static float decodeSample(const unsigned char* bytes, int format, int bytesPerSample) {
+    if (format == FORMAT_FLOAT) {
+        if (bytesPerSample == 4) {
+            unsigned int bits = readLittleEndian(bytes, 4);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        unsigned long long bits = readLittleEndian(bytes, 4) | ((unsigned long long) readLittleEndian(bytes + 4, 4) << 32);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return (float) value;
+    }
+
+    // 8 bit samples are unsigned, wider ones are signed
+    if (bytesPerSample == 1) return (bytes[0] - 128) / 128.0f;
+
+    int shift = 32 - bytesPerSample * 8;
+    int value = (int) (readLittleEndian(bytes, bytesPerSample) << shift) >> shift;
+    return value / (float) (1u << (bytesPerSample * 8 - 1));
+}
+
+bool loadWavFile(std::string path, WavFile &wav) {
+    std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        fprintf(stderr, "Failed to open %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<unsigned char> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    if (file.size() < 12 || memcmp(&file[0], "RIFF", 4) != 0 || memcmp(&file[8], "WAVE", 4) != 0) {
+        fprintf(stderr, "%s is not a WAV file\n", path.c_str());
+        return false;
+    }
+
+    int format = 0, numChannels = 0, bitsPerSample = 0;
+    const unsigned char* data = NULL;
+    size_t dataSize = 0;
+
+    // Walk the chunks, they are padded to an even size
+    size_t offset = 12;
+    while (offset + 8 <= file.size()) {
+        const unsigned char* chunk = &file[offset];
+        size_t chunkSize = readLittleEndian(chunk + 4, 4);
+        size_t available = std::min(chunkSize, file.size() - offset - 8);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && available >= 16) {
+            format = readLittleEndian(chunk + 8, 2);
+            numChannels = readLittleEndian(chunk + 10, 2);
+            wav.sampleRate = readLittleEndian(chunk + 12, 4);
+            bitsPerSample = readLittleEndian(chunk + 22, 2);
+
+            // The sub format GUID starts with the actual format tag
+            if (format == FORMAT_EXTENSIBLE && available >= 26) format = readLittleEndian(chunk + 32, 2);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            data = chunk + 8;
+            dataSize = available;
+        }
+
+        offset += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    int bytesPerSample = bitsPerSample / 8;
+    bool supported = (format == FORMAT_PCM && bytesPerSample >= 1 && bytesPerSample <= 4) ||
+                     (format == FORMAT_FLOAT && (bytesPerSample == 4 || bytesPerSample == 8));
+
+    if (!supported || numChannels <= 0 || wav.sampleRate <= 0 || data == NULL) {
+        fprintf(stderr, "%s is not an uncompressed PCM or float WAV file\n", path.c_str());
+        return false;
+    }
+
+    size_t frameSize = (size_t) numChannels * bytesPerSample;
+    size_t numFrames = dataSize / frameSize;
+
+    wav.samples.resize(numFrames);
+    for (size_t i = 0; i < numFrames; i++) {
+        float sum = 0.0f;
+        for (int channel = 0; channel < numChannels; channel++) {
+            sum += decodeSample(data + i * frameSize + channel * bytesPerSample, format, bytesPerSample);
+        }
+        wav.samples[i] = sum / numChannels;
+    }
+
+    return true;
+}
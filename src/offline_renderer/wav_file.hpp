@@ -0,0 +1,16 @@
+#ifndef SMOKEYBBQ_WAV_FILE_HPP
+#define SMOKEYBBQ_WAV_FILE_HPP
+
+#include <string>
+#include <vector>
+
+// Audio of a WAV file, the channels are mixed down to mono like the live input
+struct WavFile {
+    int sampleRate;
+    std::vector<float> samples;
+};
+
+// Reads 8, 16, 24 or 32 bit PCM and 32 or 64 bit float WAV files
+bool loadWavFile(std::string path, WavFile &wav);
+
+#endif //SMOKEYBBQ_WAV_FILE_HPP
@@ -1,6 +1,7 @@
 #include <iostream>
+#include <cmath>
+#include <cstring>
 #include <chrono>
-#include <thread>
 #include <vector>
 #include <main.hpp>
 #include <opengl.hpp>
@@ -14,6 +15,15 @@ SmokeSimulation::SmokeSimulation() {
 
     setDefaultVariables();
     setDefaultToggles();
+    updateVelocityResolution();
+    prevPrecisions = precisions;
+    stateOnGPU = useGPUImplementation;
+    turbulenceTime = 0.0f;
+    frameNumber = 0;
+    traceSubsteps = 1;
+    lastMaxSpeed = 0.0f;
+    sharpnessFence = NULL;
+    setAudioTextures(0, 0, 0, 0);
 
     // Setup vertex buffer objects
     float lineVertices[] = {
@@ -35,27 +45,63 @@ SmokeSimulation::SmokeSimulation() {
     glBindBuffer(GL_ARRAY_BUFFER, fullscreenVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(fullscreenVertices), fullscreenVertices, GL_STATIC_DRAW);
 
+    // Passes finish in the framebuffer bound at setup, the window's or an offscreen one when headless
+    GLint boundFramebuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &boundFramebuffer);
+    defaultFramebuffer = (GLuint) boundFramebuffer;
+
+    // The window is not resizable so its framebuffer size is fixed for the simulation's lifetime
+    getFramebufferSize(&framebufferWidth, &framebufferHeight);
+
+    // Setup vertex array objects, the application's own is restored after each sequence of passes
+    GLint boundVertexArray;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVertexArray);
+    defaultVertexArray = (GLuint) boundVertexArray;
+
+    glGenVertexArrays(1, &fullscreenVertexArray);
+    glBindVertexArray(fullscreenVertexArray);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(
+            0,         // shader layout attribute
+            4,         // size
+            GL_FLOAT,  // type
+            GL_FALSE,  // normalized?
+            0,         // stride
+            (void*)0   // array buffer offset
+    );
+
+    // Tiles and velocity glyphs are generated in the vertex shader and read no attributes
+    glGenVertexArrays(1, &tileVertexArray);
+    glBindVertexArray(defaultVertexArray);
+
     // Setup shaders
     simpleShader = loadShaders("SimpleVertexShader", "SimpleFragmentShader");
+    velocityGlyphShader = loadShaders("VelocityGlyphVertexShader", "SimpleFragmentShader");
+    upscaleShader = loadShaders("programs/vertexShader", "UpscaleFragmentShader");
     currentDisplay = COMPOSITION;
     fieldShaders[DENSITY] = loadShaders("SmokeVertexShader", "fields/DensityFragmentShader");
     fieldShaders[VELOCITY] = loadShaders("SmokeVertexShader", "fields/VelocityFragmentShader");
     fieldShaders[TEMPERATURE] = loadShaders("SmokeVertexShader", "fields/TemperatureFragmentShader");
     fieldShaders[CURL] = loadShaders("SmokeVertexShader", "fields/CurlFragmentShader");
 
+    cacheUniformLocations(simpleShader);
+    cacheUniformLocations(velocityGlyphShader);
+    cacheUniformLocations(upscaleShader);
+    for (std::pair<const Display, GLuint> &fieldShader : fieldShaders) {
+        cacheUniformLocations(fieldShader.second);
+    }
+
     initCPU();
     initGPU();
-
-    // Sleep for a moment to ensure everything is setup, i.e: GPU
-    #ifdef __linux__
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-    #endif
+    initCompute();
 }
 
 void SmokeSimulation::setDefaultVariables() {
     timeStep = 0.05f;
     fluidDensity = 1.0f;
     jacobiIterations = 40;
+    multigridCycles = 2;
+    smoothingIterations = 2;
 
     gravity = 0.0981f;
     pulseRange = 50.0f;
@@ -72,8 +118,19 @@ void SmokeSimulation::setDefaultVariables() {
     atmosphereTemperature = 0.0f;
 
     strokeWeight = 2.0f;
+    glyphStride = 4;
 
     vorticityConfinementForce = 5.0f;
+
+    turbulenceStrength = 0.5f;
+    turbulenceScale = 4.0f;
+
+    refinementThreshold = 0.02f;
+
+    cflTarget = 1.0f;
+    maxTraceSubsteps = 8;
+
+    velocityUpdateInterval = 1;
 }
 
 void SmokeSimulation::setDefaultToggles() {
@@ -85,10 +142,20 @@ void SmokeSimulation::setDefaultToggles() {
     randomPulseAngle = false;
     enableBuoyancy = true;
     wrapBorders = false; prevWrapBorders = wrapBorders;
+    velocityResolution = FULL;
+    upscaling = CATMULL_ROM;
+    usePrecisionPreset(STANDARD_PRECISION);
     enableVorticityConfinement = true;
+    enableTurbulence = false;
+    enableAdaptiveResolution = false;
+    enableAdaptiveSubstepping = false;
+    enableMacCormack = false;
+    enableMultigrid = false;
+    enablePackedSolver = false;
     computeIntermediateFields = false;
     useCPUMultithreading = true;
     useGPUImplementation = true;
+    useComputeImplementation = true;
 }
 
 void SmokeSimulation::reset() {
@@ -96,10 +163,81 @@ void SmokeSimulation::reset() {
     resetSlabs();
 }
 
+void SmokeSimulation::usePrecisionPreset(PrecisionPreset preset) {
+    precisions.velocity = FLOAT16;
+    precisions.temperature = FLOAT16;
+    precisions.curl = FLOAT16;
+    precisions.divergence = FLOAT16;
+
+    // Pressure converges to small differences of large values, so it keeps full precision
+    precisions.pressure = FLOAT32;
+
+    // Visual fields only need to look right, density writes are dithered to hide the 8 bit steps
+    if (preset == BANDWIDTH_SAVER) {
+        precisions.density = UNORM8;
+        precisions.rgb = FLOAT11;
+    } else {
+        precisions.density = FLOAT16;
+        precisions.rgb = FLOAT16;
+    }
+}
+
+void SmokeSimulation::updateVelocityResolution() {
+    velocityGridSize = GRID_SIZE / velocityResolution;
+    velocityGridSpacing = gridSpacing * velocityResolution;
+    prevVelocityResolution = velocityResolution;
+}
+
+void SmokeSimulation::updateTraceSubsteps(float maxSpeed, float stepScale) {
+    lastMaxSpeed = maxSpeed;
+
+    if (!enableAdaptiveSubstepping) {
+        traceSubsteps = 1;
+        return;
+    }
+
+    // Number of cells the fastest particle crosses in the step
+    float cfl = maxSpeed * timeStep * stepScale / gridSpacing;
+    traceSubsteps = glm::clamp((int) std::ceil(cfl / cflTarget), 1, maxTraceSubsteps);
+}
+
+bool SmokeSimulation::updatesVelocity() {
+
+    // In between updates the visual fields keep advecting through the last projected velocity
+    return frameNumber % glm::max(velocityUpdateInterval, 1) == 0;
+}
+
+float SmokeSimulation::velocityStepScale() {
+
+    // A velocity update steps over every frame since the last one
+    return (float) glm::max(velocityUpdateInterval, 1);
+}
+
 void SmokeSimulation::update() {
-    if (!updateSimulation) return;
 
-    glViewport(0, 0, GRID_SIZE, GRID_SIZE);
+    // Rebuild the velocity grid if the resolution changed
+    if (prevVelocityResolution != velocityResolution) {
+
+        // A read back in flight still targets the velocity transfer about to be recreated
+        if (!pendingReadbacks.empty()) cancelReadback();
+
+        updateVelocityResolution();
+        resetVelocityFields();
+        resizeVelocitySlabs();
+    }
+
+    // Recreate slabs whose precision was changed
+    updateSlabPrecisions();
+
+    // The last benchmark's density is measured once its read back lands
+    if (sharpnessFence != NULL) finishSharpnessReadback();
+
+    // Carry the simulation state over when the implementation is switched, a read back left over from a switch
+    // that was undone before it landed is dropped so the next switch reads the surfaces again
+    if (stateOnGPU == useGPUImplementation && !pendingReadbacks.empty()) cancelReadback();
+    if (stateOnGPU != useGPUImplementation && !migrateState()) return;
+
+    if (!updateSimulation) return;
 
     // Set thread limit
     omp_set_num_threads(useCPUMultithreading ? NUM_THREADS : 1);
@@ -111,13 +249,31 @@ void SmokeSimulation::update() {
         t1 = std::chrono::high_resolution_clock::now();
     }
 
-    if (useGPUImplementation) {
+    // Other code may have changed the GL state since the last update
+    glState.invalidate();
+
+    if (stateOnGPU && useComputeImplementation && computeAvailable) {
+        updateCompute();
+    } else if (stateOnGPU) {
         updateGPU();
     } else {
         updateCPU();
     }
 
+    resetState();
+
+    frameNumber++;
+
+    // Evolve the turbulence detail over time
+    if (enableTurbulence) {
+        turbulenceTime += timeStep;
+    }
+
     if (benchmarking) {
+
+        // Wait for queued GPU work so its cost is included
+        if (stateOnGPU) glFinish();
+
         t2 = std::chrono::high_resolution_clock::now();
 
         double duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
@@ -133,9 +289,31 @@ void SmokeSimulation::update() {
 
 void SmokeSimulation::setCompositionData(GLuint shader, std::vector<Display> fields) {
     compositionShader = shader;
+    cacheUniformLocations(shader);
     compositionFields = std::vector<Display>(fields);
 }
 
+void SmokeSimulation::setAudioTextures(GLuint spectrum, GLuint bands, GLuint bandHistory, int bandHistoryRow) {
+    audioTextures[0] = spectrum;
+    audioTextures[1] = bands;
+    audioTextures[2] = bandHistory;
+    this->bandHistoryRow = bandHistoryRow;
+}
+
+void SmokeSimulation::bindAudioTextures(GLuint program) {
+    UniformLocations &locations = locationsFor(program);
+
+    // Programs that never declare the audio uniforms get -1 locations, which GL ignores
+    glUniform1i(locations.spectrumTexture, AUDIO_TEXTURE_UNIT);
+    glUniform1i(locations.bandTexture, AUDIO_TEXTURE_UNIT + 1);
+    glUniform1i(locations.bandHistoryTexture, AUDIO_TEXTURE_UNIT + 2);
+    glUniform1i(locations.bandHistoryRow, bandHistoryRow);
+
+    for (int i = 0; i < NUM_AUDIO_TEXTURES; i++) {
+        glState.bindTexture(AUDIO_TEXTURE_UNIT + i, audioTextures[i]);
+    }
+}
+
 void SmokeSimulation::beginBenchmark() {
     std::cout << "Beginning benchmark" << std::endl;
 
@@ -156,10 +334,48 @@ void SmokeSimulation::finishBenchmark() {
 
     std::cout << "Benchmark result: " << averageDuration << " ms" << std::endl;
 
+    // Less diffusive advection keeps steeper density edges for the same amount of smoke.
+    // The GPU density is reported once its read back lands rather than stalling on it.
+    if (!stateOnGPU) {
+        std::cout << "Benchmark sharpness: " << densitySharpness(density) << std::endl;
+    } else if (sharpnessFence == NULL) {
+        readSurfaceIntoPixelBuffer(densitySlab.ping, sharpnessTransfer);
+        sharpnessFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        resetState();
+    }
+
     benchmarkSample = 0;
     updateTimes.clear();
 }
 
+void SmokeSimulation::finishSharpnessReadback() {
+    if (glClientWaitSync(sharpnessFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) return;
+
+    glDeleteSync(sharpnessFence);
+    sharpnessFence = NULL;
+
+    copyPixelBufferIntoField(sharpnessTransfer);
+
+    std::cout << "Benchmark sharpness: " << densitySharpness(advectedDensity) << std::endl;
+}
+
+float SmokeSimulation::densitySharpness(float field[GRID_SIZE][GRID_SIZE]) {
+    double gradientSum = 0.0;
+    double densitySum = 0.0;
+
+    for (int i = 1; i < GRID_SIZE - 1; i++) {
+        for (int j = 1; j < GRID_SIZE - 1; j++) {
+            float xChange = field[i + 1][j] - field[i - 1][j];
+            float yChange = field[i][j + 1] - field[i][j - 1];
+
+            gradientSum += 0.5f * glm::length(glm::vec2(xChange, yChange));
+            densitySum += field[i][j];
+        }
+    }
+
+    return densitySum > 0.0 ? (float) (gradientSum / densitySum) : 0.0f;
+}
+
 void SmokeSimulation::addPulse(glm::vec2 position) {
     position -= glm::vec2(gridSpacing / 2.0f, gridSpacing / 2.0f);
     position *= windowToGrid;
@@ -172,12 +388,29 @@ void SmokeSimulation::addPulse(glm::vec2 position) {
         force = pulseForce * glm::vec2(myRandom() * 2.0f - 1.0f, myRandom() * 2.0f - 1.0f);
     }
 
-    if (useGPUImplementation) {
-        applyImpulse(velocitySlab.ping, position, pulseRange, glm::vec3(force, 0.0f), true);
+    // Velocity only takes impulses on the frames it is stepped, scaled up to push as far over the interval
+    bool pushVelocity = updatesVelocity();
+    float pulseScale = velocityStepScale();
+
+    if (stateOnGPU) {
+        glState.invalidate();
+        if (pushVelocity) applyImpulse(velocitySlab.ping, position, pulseRange, glm::vec3(force * pulseScale, 0.0f), true);
         applyImpulse(densitySlab.ping, position, pulseRange, glm::vec3(addAmount, 0.0f, 0.0f), false);
         applyImpulse(temperatureSlab.ping, position, pulseRange, glm::vec3(addAmount * 5, 0.0f, 0.0f), false);
         resetState();
     } else {
+        for (int i = 0; i < velocityGridSize && pushVelocity; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                glm::vec2 gridPosition = glm::vec2(i * velocityGridSpacing, j * velocityGridSpacing);
+                float distance = glm::distance(position, gridPosition);
+
+                if (distance < pulseRange) {
+                    float falloff = 1.0f - distance / pulseRange;
+                    velocity[i][j] += (randomPulseAngle ? force : pulseForce * glm::normalize(gridPosition - position) * falloff) * pulseScale;
+                }
+            }
+        }
+
         for (int i = 0; i < GRID_SIZE; i++) {
             for (int j = 0; j < GRID_SIZE; j++) {
                 glm::vec2 gridPosition = glm::vec2(i * gridSpacing, j * gridSpacing);
@@ -185,7 +418,6 @@ void SmokeSimulation::addPulse(glm::vec2 position) {
 
                 if (distance < pulseRange) {
                     float falloff = 1.0f - distance / pulseRange;
-                    velocity[i][j] += randomPulseAngle ? force : pulseForce * glm::normalize(gridPosition - position) * falloff;
                     density[i][j] += addAmount * falloff;
                     temperature[i][j] += addAmount * 5 * falloff;
                 }
@@ -195,75 +427,95 @@ void SmokeSimulation::addPulse(glm::vec2 position) {
 }
 
 void SmokeSimulation::emit(glm::vec2 position, float range, std::vector<Display> fields, std::vector<glm::vec3> values) {
-    if (useGPUImplementation) {
+    if (stateOnGPU) {
+        glState.invalidate();
         emitGPU(position, range, fields, values);
+        resetState();
     } else {
         emitCPU(position, range, fields, values);
     }
 }
 
-void SmokeSimulation::render(glm::mat4 transform, glm::vec2 mousePosition) {
+void SmokeSimulation::applyEmitter() {
+    glm::vec2 position = glm::vec2(GRID_SIZE / 2 * SCREEN_WIDTH / GRID_SIZE, GRID_SIZE * SCREEN_HEIGHT / GRID_SIZE - 2);
+    glm::vec2 force = glm::vec2(myRandom() * pulseForce - pulseForce / 2.0f, -pulseForce);
+
+    std::vector<Display> fields = { VELOCITY, DENSITY, TEMPERATURE };
+    std::vector<glm::vec3> values = { glm::vec3(force, 0.0f), glm::vec3(0.2f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) };
+
+    // Runs within an update, so the GPU path keeps the update's bindings
+    if (stateOnGPU) {
+        emitGPU(position, emitterRange, fields, values);
+    } else {
+        emitCPU(position, emitterRange, fields, values);
+    }
+}
+
+void SmokeSimulation::render(glm::mat4 transform, glm::vec2 mousePosition, float stepFraction) {
+    glState.invalidate();
+
+    // The CPU fields are only shown at simulation steps
+    if (displaySmokeField && stateOnGPU) interpolateDisplayFieldsGPU(updateSimulation ? stepFraction : 0.0f);
+
+    // CPU fields are streamed into the next pixel buffers of the ring each frame
+    if (!stateOnGPU) uploadRingIndex = (uploadRingIndex + 1) % UPLOAD_RING_SIZE;
+
     if (displaySmokeField) {
-        resetViewportToFramebuffer();
+        if (upscaling == CATMULL_ROM) {
+            bindSurface(displaySurface);
+        } else {
+            glState.viewport(framebufferWidth, framebufferHeight);
+        }
 
         GLuint currentShader = currentDisplay == COMPOSITION ? compositionShader : fieldShaders[currentDisplay];
-        glUseProgram(currentShader);
+        glState.useProgram(currentShader);
+        UniformLocations &locations = locationsFor(currentShader);
 
         // Pass screen size uniforms
-        GLint screenWidthLocation = glGetUniformLocation(currentShader, "screenWidth");
-        GLint screenHeightLocation = glGetUniformLocation(currentShader, "screenHeight");
-        glUniform1i(screenWidthLocation, SCREEN_WIDTH);
-        glUniform1i(screenHeightLocation, SCREEN_HEIGHT);
+        glUniform1i(locations.screenWidth, SCREEN_WIDTH);
+        glUniform1i(locations.screenHeight, SCREEN_HEIGHT);
 
         // Pass texture location uniforms
-        GLint textureALocation = glGetUniformLocation(currentShader, "textureA");
-        GLint textureBLocation = glGetUniformLocation(currentShader, "textureB");
-        glUniform1i(textureALocation, 0);
-        glUniform1i(textureBLocation, 1);
+        glUniform1i(locations.textureA, 0);
+        glUniform1i(locations.textureB, 1);
+
+        bindAudioTextures(currentShader);
 
-        if (useGPUImplementation) {
+        if (stateOnGPU) {
             renderGPU();
         } else {
             renderCPU();
         }
 
         drawFullscreenQuad();
+
+        if (upscaling == CATMULL_ROM) upscaleDisplaySurface();
     }
 
-    if (displayVelocityField && !useGPUImplementation) renderVelocityField(transform, mousePosition);
+    if (displayVelocityField) renderVelocityField(transform, mousePosition);
+
+    resetState();
 }
 
 void SmokeSimulation::renderVelocityField(glm::mat4 transform, glm::vec2 mousePosition) {
-    resetViewportToFramebuffer();
-
-    glUseProgram(simpleShader);
-
-    float velocityColor[] = {0.0f, 0.0f, 1.0f, 0.0f};
-    setColor(simpleShader, velocityColor);
+    glState.viewport(framebufferWidth, framebufferHeight);
 
-    float horizontalSpacing = ((float) SCREEN_WIDTH) / GRID_SIZE;
-    float verticalSpacing = ((float) SCREEN_HEIGHT) / GRID_SIZE;
-
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            float x = i * horizontalSpacing;
-            float y = j * verticalSpacing;
-            glm::mat4 translate = glm::translate(glm::vec3(x, y, 0.0f));
-
-            translate *= glm::translate(glm::vec3(horizontalSpacing / 2.0f, verticalSpacing / 2.0f, 0.0f));
-
-            glm::vec3 velocityAmount = glm::vec3(velocity[i][j].x, velocity[i][j].y, 0.0f);
+    // Glyphs read the velocity slab directly, the CPU field is streamed up like the displayed fields
+    if (stateOnGPU) {
+        drawVelocityGlyphs(transform, velocitySlab.ping.textureHandle);
+        return;
+    }
 
-            float magnitude = max(min(glm::length(velocityAmount) / pulseForce * 1.5f, 2.0f), 0.5f);
+    streamFieldIntoTexture(velocityUpload, VELOCITY);
+    drawVelocityGlyphs(transform, velocityUpload.texture);
 
-            glm::mat4 scale = glm::scale(glm::vec3(magnitude, magnitude, 1.0f));
-            glm::mat4 rotate = glm::orientation(glm::normalize(velocityAmount), glm::vec3(0.0f, 1.0f, 0.0f));
-
-            drawLine(transform * translate * scale * rotate);
-        }
-    }
+    float horizontalSpacing = ((float) SCREEN_WIDTH) / velocityGridSize;
+    float verticalSpacing = ((float) SCREEN_HEIGHT) / velocityGridSize;
 
     // Draw interpolated velocity and mouse position
+    glState.useProgram(simpleShader);
+    glState.bindVertexArray(defaultVertexArray);
+
     glm::mat4 translate = glm::translate(glm::vec3(mousePosition, 0.0f));
 
     glm::vec2 velocityAmount = getVelocity(mousePosition.x - horizontalSpacing / 2.0f, mousePosition.y - verticalSpacing / 2.0f);
@@ -277,9 +529,34 @@ void SmokeSimulation::renderVelocityField(glm::mat4 transform, glm::vec2 mousePo
     drawLine(transform * translate * scale * rotate);
 }
 
+void SmokeSimulation::drawVelocityGlyphs(glm::mat4 transform, GLuint velocityTexture) {
+    glState.useProgram(velocityGlyphShader);
+    UniformLocations &locations = locationsFor(velocityGlyphShader);
+
+    float velocityColor[] = {0.0f, 0.0f, 1.0f, 0.0f};
+    setColor(velocityGlyphShader, velocityColor);
+
+    int stride = max(glyphStride, 1);
+    int glyphsAcross = (velocityGridSize + stride - 1) / stride;
+
+    glUniformMatrix4fv(locations.MVP, 1, GL_FALSE, &transform[0][0]);
+    glUniform1i(locations.screenWidth, SCREEN_WIDTH);
+    glUniform1i(locations.screenHeight, SCREEN_HEIGHT);
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1i(locations.stride, stride);
+    glUniform1f(locations.magnitude, 1.5f / pulseForce);
+    glUniform2f(locations.glyphSize, strokeWeight, gridSpacing / 2.5f * stride);
+    glUniform1i(locations.velocityTexture, 0);
+
+    glState.bindTexture(0, velocityTexture);
+
+    // One instance per glyph, each a strip of four vertices
+    glState.bindVertexArray(tileVertexArray);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, glyphsAcross * glyphsAcross);
+}
+
 void SmokeSimulation::drawLine(glm::mat4 transform) {
-    GLint transformID = glGetUniformLocation(3, "MVP");
-    glUniformMatrix4fv(transformID, 1, GL_FALSE, &transform[0][0]);
+    glUniformMatrix4fv(locationsFor(simpleShader).MVP, 1, GL_FALSE, &transform[0][0]);
 
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
@@ -297,84 +574,157 @@ void SmokeSimulation::drawLine(glm::mat4 transform) {
 }
 
 void SmokeSimulation::drawFullscreenQuad() {
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, fullscreenVBO);
-    glVertexAttribPointer(
-            0,         // shader layout attribute
-            4,         // size
-            GL_FLOAT,  // type
-            GL_FALSE,  // normalized?
-            0,         // stride
-            (void*)0   // array buffer offset
-    );
-
+    glState.disableBlend();
+    glState.bindVertexArray(fullscreenVertexArray);
     glDrawArrays(GL_TRIANGLES, 0, 3);
+}
 
-    glDisableVertexAttribArray(0);
+void SmokeSimulation::drawFullscreenQuad(GLenum blendSource, GLenum blendDestination) {
+    glState.enableBlend(blendSource, blendDestination);
+    glState.bindVertexArray(fullscreenVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
-void SmokeSimulation::copyVectorTextureIntoField(GLuint textureHandle, glm::vec2 field[GRID_SIZE][GRID_SIZE]) {
-    GLfloat* pixels = new GLfloat[GRID_SIZE * GRID_SIZE * 2];
+bool SmokeSimulation::migrateState() {
+    glState.invalidate();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, pixels);
+    bool migrated = true;
 
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            float xValue = pixels[(GRID_SIZE * i + j) * 2];
-            float yValue = pixels[(GRID_SIZE * i + j) * 2 + 1];
+    if (useGPUImplementation) {
 
-            if (isnan(xValue)) xValue = 0.0f;
-            if (isnan(yValue)) yValue = 0.0f;
+        // Uploads are ordered before the passes that read them, so neither side waits
+        uploadState();
+    } else {
 
-            field[j][i].x = xValue;
-            field[j][i].y = yValue;
-        }
+        // The simulation holds for the frames the read back takes to land rather than stalling on it
+        if (pendingReadbacks.empty()) beginReadback();
+        migrated = finishReadback();
     }
 
-    delete[] pixels;
+    resetState();
+
+    if (migrated) stateOnGPU = useGPUImplementation;
+    return migrated;
 }
 
-void SmokeSimulation::copyScalarTextureIntoField(GLuint textureHandle, float field[GRID_SIZE][GRID_SIZE]) {
-    GLfloat* pixels = new GLfloat[GRID_SIZE * GRID_SIZE];
+void SmokeSimulation::uploadState() {
+    copyFieldIntoSurface(velocityTransfer, velocitySlab.ping);
+    copyFieldIntoSurface(densityTransfer, densitySlab.ping);
+    copyFieldIntoSurface(temperatureTransfer, temperatureSlab.ping);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, pixels);
+    if (advectsRgb()) {
+        allocateRgbSlab();
+        copyFieldIntoSurface(rgbTransfer, rgbSlab.ping);
+    }
+}
 
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            float value = pixels[(GRID_SIZE * i + j)];
+void SmokeSimulation::beginReadback() {
+    pendingReadbacks.push_back(readSurfaceIntoPixelBuffer(velocitySlab.ping, velocityTransfer));
+    pendingReadbacks.push_back(readSurfaceIntoPixelBuffer(densitySlab.ping, densityTransfer));
+    pendingReadbacks.push_back(readSurfaceIntoPixelBuffer(temperatureSlab.ping, temperatureTransfer));
 
-            if (isnan(value)) value = 0.0f;
+    if (rgbAllocated) {
+        pendingReadbacks.push_back(readSurfaceIntoPixelBuffer(rgbSlab.ping, rgbTransfer));
+    }
 
-            field[j][i] = value;
-        }
+    readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool SmokeSimulation::finishReadback() {
+    if (glClientWaitSync(readbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) return false;
+
+    glDeleteSync(readbackFence);
+
+    for (FieldTransfer transfer : pendingReadbacks) {
+        copyPixelBufferIntoField(transfer);
     }
+    pendingReadbacks.clear();
 
-    delete[] pixels;
+    return true;
 }
 
-void SmokeSimulation::loadVectorFieldIntoTexture(GLuint textureHandle, vec2 **field) {
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            invertVectorField[i][j][0] = field[j][i].x;
-            invertVectorField[i][j][1] = field[j][i].y;
-        }
+void SmokeSimulation::cancelReadback() {
+    glDeleteSync(readbackFence);
+    pendingReadbacks.clear();
+}
+
+void SmokeSimulation::createFieldTransfers() {
+    velocityTransfer = createFieldTransfer(&velocity[0][0].x, velocityGridSize, velocityGridSize, 2);
+    densityTransfer = createFieldTransfer(&density[0][0], GRID_SIZE, GRID_SIZE, 1);
+    temperatureTransfer = createFieldTransfer(&temperature[0][0], GRID_SIZE, GRID_SIZE, 1);
+    rgbTransfer = createFieldTransfer(&rgb[0][0].x, GRID_SIZE, GRID_SIZE, 3);
+    sharpnessTransfer = createFieldTransfer(&advectedDensity[0][0], GRID_SIZE, GRID_SIZE, 1);
+}
+
+SmokeSimulation::FieldTransfer SmokeSimulation::createFieldTransfer(float *field, int width, int height, int numComponents) {
+    FieldTransfer transfer;
+    transfer.field = field;
+    transfer.numComponents = numComponents;
+
+    // Three component float targets are optional, so rgb is staged in four
+    transfer.staging = createSurface(width, height, numComponents == 3 ? 4 : numComponents, FLOAT32);
+
+    glGenBuffers(1, &transfer.pixelBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, transfer.pixelBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, width * height * numComponents * sizeof(float), NULL, GL_STREAM_COPY);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return transfer;
+}
+
+void SmokeSimulation::deleteFieldTransfer(FieldTransfer transfer) {
+    glDeleteBuffers(1, &transfer.pixelBuffer);
+    deleteSurface(transfer.staging);
+}
+
+SmokeSimulation::FieldTransfer SmokeSimulation::readSurfaceIntoPixelBuffer(Surface source, FieldTransfer transfer) {
+    transposeSurface(source, transfer.staging);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, transfer.pixelBuffer);
+    glReadPixels(0, 0, source.width, source.height, formatFor(source.numComponents), GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return transfer;
+}
+
+void SmokeSimulation::copyPixelBufferIntoField(FieldTransfer transfer) {
+    int width = transfer.staging.width;
+    int height = transfer.staging.height;
+    int numComponents = transfer.numComponents;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, transfer.pixelBuffer);
+    float *pixels = (float*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * numComponents * sizeof(float), GL_MAP_READ_BIT);
+
+    // The surface was transposed, so each row is a column of the field
+    #pragma omp parallel for
+    for (int i = 0; i < height; i++) {
+        memcpy(transfer.field + i * GRID_SIZE * numComponents, pixels + i * width * numComponents, width * numComponents * sizeof(float));
     }
 
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, GRID_SIZE, GRID_SIZE, 0, GL_RG, GL_FLOAT, &invertVectorField[0][0][0]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
-void SmokeSimulation::loadScalarFieldIntoTexture(GLuint textureHandle, float **field) {
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            invertScalarField[i][j] = field[j][i];
-        }
+void SmokeSimulation::copyFieldIntoSurface(FieldTransfer transfer, Surface destination) {
+    int width = destination.width;
+    int height = destination.height;
+    int numComponents = destination.numComponents;
+    float *field = transfer.field;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, transfer.pixelBuffer);
+    float *pixels = (float*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, width * height * numComponents * sizeof(float),
+                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    // Columns of the field are uploaded as rows and transposed back on the GPU
+    #pragma omp parallel for
+    for (int i = 0; i < height; i++) {
+        memcpy(pixels + i * width * numComponents, field + i * GRID_SIZE * numComponents, width * numComponents * sizeof(float));
     }
 
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, GRID_SIZE, GRID_SIZE, 0, GL_RED, GL_FLOAT, &invertScalarField[0][0]);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glState.bindTexture(0, transfer.staging.textureHandle);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, formatFor(numComponents), GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    transposeSurface(transfer.staging, destination);
 }
@@ -2,7 +2,10 @@
 #define SMOKE_SIMULATION_HPP
 
 #include <map>
+#include <string>
 #include <opengl.hpp>
+#include <glState.hpp>
+#include <frameGraph.hpp>
 
 class SmokeSimulation {
 
@@ -11,11 +14,15 @@ public:
     // Constants
     static constexpr int GRID_SIZE = 512;
     static constexpr int BENCHMARK_SAMPLES = 60;
+    static constexpr int TILE_SIZE = 16;
+    static constexpr int NUM_TILES = GRID_SIZE / TILE_SIZE;
 
     // Variables
     float timeStep;
     float fluidDensity;
     int jacobiIterations;
+    int multigridCycles;
+    int smoothingIterations;
 
     float gravity;
     float pulseRange;
@@ -32,9 +39,22 @@ public:
     float atmosphereTemperature;
 
     float strokeWeight;
+    int glyphStride;
 
     float vorticityConfinementForce;
 
+    float turbulenceStrength;
+    float turbulenceScale;
+
+    float refinementThreshold;
+
+    float cflTarget;
+    int maxTraceSubsteps;
+    int traceSubsteps;
+
+    // Frames between velocity and projection updates, the visual fields advect every frame
+    int velocityUpdateInterval;
+
     // Benchmarking variables
     bool benchmarking;
     int benchmarkSample;
@@ -57,16 +77,58 @@ public:
     };
     Display currentDisplay;
 
+    // Grid resolution toggle, as a divisor of GRID_SIZE
+    enum Resolution {
+        FULL = 1,
+        HALF = 2,
+        QUARTER = 4
+    };
+    Resolution velocityResolution, prevVelocityResolution;
+
+    // Display upscaling toggle, either shading every framebuffer pixel from bilinear fields or
+    // shading at the field resolution and filtering that up to the framebuffer
+    enum Upscaling {
+        BILINEAR,
+        CATMULL_ROM
+    };
+    Upscaling upscaling;
+
+    // Texture precision toggle, per slab
+    enum Precision {
+        FLOAT32,
+        FLOAT16,
+        FLOAT11, // R11F_G11F_B10F, for unsigned three component slabs
+        UNORM8   // Clamped to [0, 1], for unsigned slabs
+    };
+    struct SlabPrecisions {
+        Precision velocity;
+        Precision density;
+        Precision temperature;
+        Precision curl;
+        Precision divergence;
+        Precision pressure;
+        Precision rgb;
+    };
+    SlabPrecisions precisions, prevPrecisions;
+
+    // Precision presets
+    enum PrecisionPreset {
+        STANDARD_PRECISION,
+        BANDWIDTH_SAVER
+    };
+    void usePrecisionPreset(PrecisionPreset preset);
+
     // Updating
     void update();
     void setCompositionData(GLuint shader, std::vector<Display> fields);
+    void setAudioTextures(GLuint spectrum, GLuint bands, GLuint bandHistory, int bandHistoryRow);
 
     // Benchmarking
     void beginBenchmark();
     void finishBenchmark();
 
     // Rendering
-    void render(glm::mat4 transform, glm::vec2 mousePosition);
+    void render(glm::mat4 transform, glm::vec2 mousePosition, float stepFraction = 0.0f);
 
     // Interactions
     void addPulse(glm::vec2);
@@ -82,35 +144,84 @@ public:
     bool enableBuoyancy;
     bool wrapBorders, prevWrapBorders;
     bool enableVorticityConfinement;
+    bool enableTurbulence;
+    bool enableAdaptiveResolution;
+    bool enableAdaptiveSubstepping;
+    bool enableMacCormack;
+    bool enableMultigrid;
+    bool enablePackedSolver;
     bool computeIntermediateFields;
     bool useCPUMultithreading;
     bool useGPUImplementation;
+    bool useComputeImplementation;
+
+    // Compute shaders need a GL 4.3 context
+    bool computeAvailable;
+
+    // Implementation holding the simulation state, trails useGPUImplementation while a switch migrates it
+    bool stateOnGPU;
 
 private:
 
     // Instance variables
     float gridSpacing;
+    int velocityGridSize;
+    float velocityGridSpacing;
+    float turbulenceTime;
+    int frameNumber;
+
+    // Resolution
+    void updateVelocityResolution();
+
+    // Substepping
+    float lastMaxSpeed;
+    void updateTraceSubsteps(float maxSpeed, float stepScale = 1.0f);
+
+    // Multi-rate updates
+    bool updatesVelocity();
+    float velocityStepScale();
+
+    // Emitter, shared by every implementation so they inject the same smoke
+    void applyEmitter();
 
     // Vertex buffer objects
     GLuint lineVBO;
     GLuint fullscreenVBO;
 
+    // Framebuffer the displayed fields are drawn into
+    GLuint defaultFramebuffer;
+    int framebufferWidth;
+    int framebufferHeight;
+
+    // Vertex array objects, the fullscreen triangle keeps its attribute setup between draws
+    GLuint defaultVertexArray;
+    GLuint fullscreenVertexArray;
+    GLuint tileVertexArray;
+
+    // Cached GL bindings, shared by every pass
+    GLState glState;
+
     // Shaders
     GLuint simpleShader;
+    GLuint velocityGlyphShader;
+    GLuint upscaleShader;
     GLuint compositionShader;
     std::vector<Display> compositionFields;
     std::map<Display, GLuint> fieldShaders;
 
+    // Audio feature textures, bound on the units after the samplers' so any program can read them
+    static constexpr int AUDIO_TEXTURE_UNIT = 4;
+    static constexpr int NUM_AUDIO_TEXTURES = 3;
+    GLuint audioTextures[NUM_AUDIO_TEXTURES];
+    int bandHistoryRow;
+    void bindAudioTextures(GLuint program);
+
     // Rendering
     void drawFullscreenQuad();
+    void drawFullscreenQuad(GLenum blendSource, GLenum blendDestination);
 
-    // Implementation transfer fields and functions
-    float invertVectorField[GRID_SIZE][GRID_SIZE][2];
-    float invertScalarField[GRID_SIZE][GRID_SIZE];
-    void copyVectorTextureIntoField(GLuint textureHandle, glm::vec2 field[GRID_SIZE][GRID_SIZE]);
-    void copyScalarTextureIntoField(GLuint textureHandle, float field[GRID_SIZE][GRID_SIZE]);
-    void loadVectorFieldIntoTexture(GLuint textureHandle, glm::vec2 **field);
-    void loadScalarFieldIntoTexture(GLuint textureHandle, float **field);
+    // Benchmarking
+    float densitySharpness(float field[GRID_SIZE][GRID_SIZE]);
 
 
     // ~~~~~~~~~~~~~~~~~~ //
@@ -121,6 +232,7 @@ private:
     // Setup
     void initCPU();
     void resetFields();
+    void resetVelocityFields();
 
     // Core
     void updateCPU();
@@ -141,21 +253,46 @@ private:
     float temperature[GRID_SIZE][GRID_SIZE];
     float advectedTemperatue[GRID_SIZE][GRID_SIZE];
     glm::vec2 tracePosition[GRID_SIZE][GRID_SIZE];
+    glm::vec2 turbulentTracePosition[GRID_SIZE][GRID_SIZE];
+    glm::vec2 forwardTracePosition[GRID_SIZE][GRID_SIZE];
     float curl[GRID_SIZE][GRID_SIZE];
     glm::vec3 rgb[GRID_SIZE][GRID_SIZE];
     glm::vec3 advectedRgb[GRID_SIZE][GRID_SIZE];
+    glm::vec2 correctedVelocity[GRID_SIZE][GRID_SIZE];
+    float correctedDensity[GRID_SIZE][GRID_SIZE];
+    float correctedTemperature[GRID_SIZE][GRID_SIZE];
+    glm::vec3 correctedRgb[GRID_SIZE][GRID_SIZE];
+    int tileLevels[NUM_TILES][NUM_TILES];
+
+    // Rendering textures, streamed in half floats through a ring of pixel buffers
+    static constexpr int UPLOAD_RING_SIZE = 3;
+    static constexpr GLuint64 UPLOAD_FENCE_TIMEOUT = 1000000000; // nanoseconds
+    struct FieldUpload {
+        GLuint texture;
+        int numComponents;
+        GLuint pixelBuffers[UPLOAD_RING_SIZE];
+        GLhalf *mappedPixels[UPLOAD_RING_SIZE];
+        GLsync fences[UPLOAD_RING_SIZE];
+    };
+    FieldUpload fieldUploadA;
+    FieldUpload fieldUploadB;
+    FieldUpload velocityUpload;
+    int uploadRingIndex;
 
-    // Rendering fields and textures
-    glm::vec3 textureFieldA[GRID_SIZE][GRID_SIZE];
-    glm::vec3 textureFieldB[GRID_SIZE][GRID_SIZE];
-    GLuint textureA;
-    GLuint textureB;
+    // Pixel buffers stay mapped with immutable buffer storage, a GL 4.4 feature
+    bool persistentUploadAvailable;
+    FieldUpload createFieldUpload();
+    void streamFieldIntoTexture(FieldUpload &upload, Display display);
+    int componentsForDisplayCPU(Display display);
 
     // Algorithm
-    glm::vec2 traceParticle(float x, float y);
+    glm::vec2 traceParticle(float x, float y, float step);
+    glm::vec2 turbulenceAt(float x, float y, float speed);
     glm::vec2 buoyancyForceAt(int i, int j);
     float curlAt(int i, int j);
     glm::vec2 vorticityConfinementForceAt(int i, int j);
+    void updateTileLevels();
+    void advectTilesCPU(bool advectRgb);
     float divergenceAt(int i, int j);
     float pressureAt(int i, int j);
 
@@ -180,12 +317,13 @@ private:
     glm::vec3 getGridRgb(int i, int j);
 
     // Indexing
-    int wrapIndex(int i);
-    bool clampBoundary(int &i);
-    int clampIndex(int i);
+    int wrapIndex(int i, int size);
+    bool clampBoundary(int &i, int size);
+    int clampIndex(int i, int size);
 
     // Rendering
     void renderVelocityField(glm::mat4 transform, glm::vec2 mousePosition);
+    void drawVelocityGlyphs(glm::mat4 transform, GLuint velocityTexture);
     void drawLine(glm::mat4);
 
 
@@ -199,14 +337,56 @@ private:
         GLuint fboHandle;
         GLuint textureHandle;
         int numComponents;
+        int width;
+        int height;
+        GLenum internalFormat;
     };
     struct Slab {
         Surface ping;
         Surface pong;
     };
+    struct Levels {
+        Surface half;
+        Surface quarter;
+    };
+    struct MultigridLevel {
+        Surface rhs;
+        Slab correction;
+        Surface residual;
+    };
+
+    // Uniform locations of a program, -1 for uniforms it does not use
+    struct UniformLocations {
+        GLint velocityTexture, sourceTexture, forwardTexture, backwardTexture;
+        GLint densityTexture, temperatureTexture, rgbTexture, curlTexture;
+        GLint divergenceTexture, pressureTexture, residualTexture, packedTexture;
+        GLint tileLevelTexture, textureA, textureB;
+        GLint spectrumTexture, bandTexture, bandHistoryTexture, bandHistoryRow;
+        GLint gridSize, inverseSize, gridSpacing;
+        GLint dissipation, traceSubsteps, macCormack, backward, advectRgb, turbulence, quantization;
+        GLint position, radius, fill, outwardImpulse;
+        GLint gradientScale, buoyancy, fallForce, riseForce, atmosphereTemperature, gravity;
+        GLint vorticityConfinement, vorticityConfinementForce;
+        GLint refinementThreshold, rotationScale, tileSize, velocityScale, numTiles, level, padding;
+        GLint magnitude, sourceSize, stride, weight, parity, scale, iterations;
+        GLint screenWidth, screenHeight, MVP, glyphSize;
+    };
+
+    // Per frame constants, laid out to match the std140 FrameUniforms block
+    struct FrameUniforms {
+        GLint velocityGridSize;
+        GLfloat velocityInverseSize;
+        GLfloat velocityGridSpacing;
+        GLfloat timeStep;
+        GLfloat turbulenceFrequency;
+        GLfloat turbulenceTime;
+        GLint frameNumber;
+    };
+    static constexpr GLuint FRAME_UNIFORMS_BINDING = 0;
 
     // Fragment programs
     GLuint advectProgram;
+    GLuint advectFieldsProgram;
     GLuint applyImpulseProgram;
     GLuint applyBuoyancyProgram;
     GLuint computeCurlProgram;
@@ -214,52 +394,240 @@ private:
     GLuint computeDivergenceProgram;
     GLuint jacobiProgram;
     GLuint applyPressureProgram;
+    GLuint computeTileLevelsProgram;
+    GLuint tileAdvectProgram;
+    GLuint tileUpsampleProgram;
+    GLuint reduceMaxProgram;
+    GLuint computeResidualProgram;
+    GLuint restrictResidualProgram;
+    GLuint prolongProgram;
+    GLuint packProgram;
+    GLuint unpackProgram;
+    GLuint redBlackProgram;
+    GLuint transposeProgram;
 
     // Slabs
-    std::vector<Slab> slabs;
+    std::vector<Slab*> slabs;
     Slab velocitySlab;
     Slab densitySlab;
     Slab temperatureSlab;
-    Slab curlSlab;
-    Slab divergenceSlab;
     Slab pressureSlab;
-    Slab rgbSlab;
 
-    // Samplers
+    // Rgb slabs only exist while a composition shows rgb
+    Slab rgbSlab;
+    bool rgbAllocated;
+
+    // Transient surfaces, drawn from a pool each update as the frame graph assigns them
+    Surface curlSurface;
+    Surface divergenceSurface;
+    std::vector<Surface> transientSurfaces;
+    std::vector<int> transientFormats;
+
+    // Adaptive resolution surfaces
+    Surface tileLevelSurface;
+    Levels densityLevels;
+    Levels temperatureLevels;
+    Levels rgbLevels;
+
+    // Displayed fields are shaded here at the field resolution before being upscaled
+    Surface displaySurface;
+
+    // Textures shown by the display shader, possibly carried forward past the last step
+    GLuint displayTextures[2];
+
+    // Multigrid hierarchy, level zero solves into the pressure slab
+    static constexpr int MULTIGRID_COARSEST_SIZE = 8;
+    static constexpr int MULTIGRID_COARSEST_ITERATIONS = 16;
+    std::vector<MultigridLevel> multigridLevels;
+
+    // Pressure solve with 2x2 cell blocks packed into each texel
+    Surface packedDivergenceSurface;
+    Slab packedPressureSlab;
+
+    // MacCormack forward and backward step surfaces
+    Slab macCormackVelocitySlab;
+    Slab macCormackScalarSlab;
+    Slab macCormackRgbSlab;
+
+    // Framebuffer with the visual field destinations attached as multiple render targets
+    GLuint fieldsFramebuffer;
+
+    // Max reduction surfaces, halving down to a single texel
+    std::vector<Surface> reductionSurfaces;
+    GLuint maxSpeedBuffer;
+
+    // Implementation transfer, fields are copied through pixel buffers and transposed on the GPU.
+    // Each field keeps its staging surface and pixel buffer, which serve both directions.
+    struct FieldTransfer {
+        Surface staging;
+        GLuint pixelBuffer;
+        float *field;
+        int numComponents;
+    };
+    FieldTransfer velocityTransfer;
+    FieldTransfer densityTransfer;
+    FieldTransfer temperatureTransfer;
+    FieldTransfer rgbTransfer;
+    std::vector<FieldTransfer> pendingReadbacks;
+    GLsync readbackFence;
+    bool migrateState();
+    void uploadState();
+    void beginReadback();
+    bool finishReadback();
+    void cancelReadback();
+    void createFieldTransfers();
+    FieldTransfer createFieldTransfer(float *field, int width, int height, int numComponents);
+    void deleteFieldTransfer(FieldTransfer transfer);
+    FieldTransfer readSurfaceIntoPixelBuffer(Surface source, FieldTransfer transfer);
+    void copyPixelBufferIntoField(FieldTransfer transfer);
+    void copyFieldIntoSurface(FieldTransfer transfer, Surface destination);
+
+    // Benchmark density, read back after the run and measured once it lands
+    FieldTransfer sharpnessTransfer;
+    GLsync sharpnessFence;
+    void finishSharpnessReadback();
+
+    // Samplers, bound to the texture units the passes read from
+    static constexpr int SAMPLER_UNITS = 4;
     GLuint boundedSampler;
     GLuint wrapBordersSampler;
 
+    // Passes of the current update and the resources they read and write
+    struct FrameResources {
+        FrameGraph::Resource velocity, density, temperature, rgb, pressure;
+        FrameGraph::Resource traceSubsteps, tileLevels, curl, divergence;
+    };
+    FrameGraph frameGraph;
+
+    // Program permutations, keyed by their shaders and defines
+    std::map<std::string, GLuint> programVariants;
+
+    // Uniforms
+    std::map<GLuint, UniformLocations> uniformLocations;
+    GLuint frameUniformBuffer;
+
     // Setup
     void initGPU();
     void initPrograms();
     void initSlabs();
-    Slab createSlab(int width, int height, int numComponents);
-    Surface createSurface(int width, int height, int numComponents);
-    void updateSampler();
+    void resizeVelocitySlabs();
+    Slab createSlab(int width, int height, int numComponents, Precision precision = FLOAT16);
+    Surface createSurface(int width, int height, int numComponents, Precision precision = FLOAT16);
+    GLenum formatFor(int numComponents);
+    GLenum internalFormatFor(int numComponents, Precision precision);
+    bool isRenderable(GLenum internalFormat);
+    float quantizationStep(Surface s);
+    void updateSlabPrecisions();
+    void changeSlabPrecision(Slab &slab, Precision precision);
+    Levels createLevels(int numComponents);
+    void createReductionSurfaces();
+    void createMultigridLevels();
+    void deleteMultigridLevels();
+    void deleteSurface(Surface s);
+    void deleteSlab(Slab slab);
+    void allocateRgbSlab();
+    void releaseRgbSlab();
+    int transientFormat(int size, int numComponents, Precision precision);
+    void allocateTransientSurfaces();
+    Surface transientSurface(FrameGraph::Resource resource);
+    std::string boundaryDefines();
+    GLuint loadProgram(std::string vertexShader, std::string fragmentShader);
+    void updateBoundaryMode();
+    void bindSamplers();
+    void cacheUniformLocations(GLuint program);
+    UniformLocations &locationsFor(GLuint program);
+    void updateFrameUniforms(float stepFraction = 1.0f);
 
     // Core
+    bool advectsRgb();
+    FrameResources declareFrameResources();
+    void executeFrameGraph(FrameResources resources);
+    void addEmitterPass(FrameResources resources);
+    float beginVelocityStep();
+    void endVelocityStep();
     void updateGPU();
     void renderGPU();
+    void interpolateDisplayFieldsGPU(float stepFraction);
+    void upscaleDisplaySurface();
     Slab dataForDisplayGPU(Display display);
 
     // Interactions
     void emitGPU(glm::vec2 position, float range, std::vector<Display> fields, std::vector<glm::vec3> values);
 
     // State functions
+    void bindSurface(Surface s);
     void swapSurfaces(Slab &slab);
     void clearSurface(Surface s, float v);
+    void copySurface(Surface source, Surface destination);
     void resetSlabs();
     void resetState();
+    void drawTiles(GLuint program, Resolution level, float padding);
 
     // Algorithm
     void advect(Surface velocitySurface, Surface source, Surface destination, float dissipation);
+    void advectTiles(Surface velocitySurface, Surface source, Surface destination, float dissipation, Resolution level);
+    void advectField(Surface velocitySurface, Slab slab, Levels levels, Slab scratch, float dissipation);
+    void advectMacCormack(Surface velocitySurface, Surface source, Surface destination, Slab scratch, float dissipation);
+    void prepareAdvect(GLuint program, Surface velocitySurface, Surface source, Surface destination, float dissipation);
+    void advectFields(Surface velocitySurface, bool advectRgb);
+    void upsampleTiles(Surface source, Surface destination, Resolution level);
+    void computeTileLevels(Surface densitySurface, Surface velocitySurface, Surface levelSurface);
+    float reduceMaxSpeed(Surface velocitySurface);
     void applyImpulse(Surface destination, glm::vec2 position, float radius, glm::vec3 fill, bool allowOutwardImpulse);
     void applyBuoyancy(Surface temperatureSurface, Surface densitySurface, Surface velocityDestination);
     void computeCurl(Surface velocitySurface, Surface curlSurface);
     void applyVorticityConfinement(Surface curlSurface, Surface velocityDestination);
     void computeDivergence(Surface velocitySurface, Surface divergenceSurface);
-    void jacobi(Surface divergenceSurface, Surface pressureSource, Surface pressureDestination);
+    void jacobi(Surface divergenceSurface, Surface pressureSource, Surface pressureDestination, int stride, float weight);
+    void computeResidual(Surface divergenceSurface, Surface pressureSurface, Surface residualSurface, int stride);
+    void restrictResidual(Surface residualSurface, Surface rhsSurface, float scale);
+    void prolongCorrection(Surface correctionSurface, Surface pressureDestination);
+    void smoothMultigridLevel(int level, int iterations, float weight);
+    void multigridCycle();
+    void pack(Surface source, Surface destination);
+    void unpack(Surface packedSurface, Surface destination);
+    void redBlack(Surface packedDivergenceSurface, Surface pressureSource, Surface pressureDestination, int parity);
+    void solvePressure();
     void applyPressure(Surface pressureSurface, Surface velocityDestination);
+    void transposeSurface(Surface source, Surface destination);
+
+
+    // ~~~~~~~~~~~~~~~~~~~~~~ //
+    // Compute Implementation //
+    // ~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+    // Constants, matching the kernels
+    static constexpr int COMPUTE_TILE_SIZE = 16;
+    static constexpr int COMPUTE_JACOBI_TILE_SIZE = 32;
+    static constexpr int COMPUTE_JACOBI_ITERATIONS = 4;
+
+    // Compute kernels
+    GLuint advectKernel;
+    GLuint applyForcesKernel;
+    GLuint computeDivergenceKernel;
+    GLuint jacobiKernel;
+    GLuint applyPressureKernel;
+
+    // Setup
+    void initCompute();
+    void initKernels();
+    GLuint loadKernel(std::string computeShader);
+
+    // Core
+    void updateCompute();
+
+    // State functions
+    void bindImage(GLuint unit, Surface s, GLenum access);
+    void dispatchTiles(Surface destination, int tileSize);
+
+    // Algorithm
+    void dispatchAdvect(Surface velocitySurface, Surface source, Surface destination, float dissipation);
+    void dispatchAdvectField(Surface velocitySurface, Slab slab, Levels levels, Slab scratch, float dissipation);
+    void dispatchForces(Surface temperatureSurface, Surface densitySurface, Surface velocitySurface, Surface velocityDestination, Surface curlDestination);
+    void dispatchDivergence(Surface velocitySurface, Surface divergenceSurface);
+    void dispatchJacobi(Surface divergenceSurface, Surface pressureSource, Surface pressureDestination, int iterations);
+    void dispatchApplyPressure(Surface pressureSurface, Surface velocitySurface, Surface velocityDestination);
 
 };
 
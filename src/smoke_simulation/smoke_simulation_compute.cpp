@@ -0,0 +1,268 @@
+#include <iostream>
+#include <algorithm>
+#include <main.hpp>
+#include <opengl.hpp>
+#include <smoke_simulation/smoke_simulation.hpp>
+#include <shaderLoader.hpp>
+
+void SmokeSimulation::initCompute() {
+
+    // Without compute shaders the fragment programs are used instead. main asks for a 3.3 core context, so this
+    // is false unless the driver hands back a newer context than requested, as Mesa and most Linux drivers do
+    computeAvailable = GLEW_VERSION_4_3;
+    if (!computeAvailable) return;
+
+    initKernels();
+}
+
+void SmokeSimulation::initKernels() {
+
+    // Kernels are compiled for the current boundary mode
+    advectKernel = loadKernel("compute/advect");
+    applyForcesKernel = loadKernel("compute/applyForces");
+    computeDivergenceKernel = loadKernel("compute/computeDivergence");
+    jacobiKernel = loadKernel("compute/jacobi");
+    applyPressureKernel = loadKernel("compute/applyPressure");
+}
+
+GLuint SmokeSimulation::loadKernel(std::string computeShader) {
+    std::string defines = boundaryDefines();
+    std::string key = computeShader + "|" + defines;
+
+    if (programVariants.count(key) == 0) {
+        GLuint kernel = loadComputeShader(computeShader, defines);
+        cacheUniformLocations(kernel);
+        programVariants[key] = kernel;
+    }
+
+    return programVariants[key];
+}
+
+void SmokeSimulation::bindImage(GLuint unit, Surface s, GLenum access) {
+    glBindImageTexture(unit, s.textureHandle, 0, GL_FALSE, 0, access, s.internalFormat);
+}
+
+void SmokeSimulation::dispatchTiles(Surface destination, int tileSize) {
+    glDispatchCompute((destination.width + tileSize - 1) / tileSize,
+                      (destination.height + tileSize - 1) / tileSize, 1);
+
+    // Make the writes visible to the following kernels, fragment programs and framebuffer operations
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+void SmokeSimulation::updateCompute() {
+
+    // Switch to the program permutations for the boundary mode if needed
+    if (prevWrapBorders != wrapBorders) {
+        updateBoundaryMode();
+    }
+    prevWrapBorders = wrapBorders;
+
+    bindSamplers();
+
+    updateFrameUniforms();
+
+    bool advectRgb = advectsRgb();
+    if (advectRgb) {
+        allocateRgbSlab();
+    } else {
+        releaseRgbSlab();
+    }
+
+    bool stepVelocity = updatesVelocity();
+
+    FrameResources r = declareFrameResources();
+
+    // Advect velocity through velocity
+    if (stepVelocity) {
+        frameGraph.addPass("advectVelocity", { r.velocity, r.traceSubsteps }, { r.velocity, r.traceSubsteps }, [this]() {
+            float dissipation = beginVelocityStep();
+            if (enableMacCormack) {
+                advectMacCormack(velocitySlab.ping, velocitySlab.ping, velocitySlab.pong, macCormackVelocitySlab, dissipation);
+            } else {
+                dispatchAdvect(velocitySlab.ping, velocitySlab.ping, velocitySlab.pong, dissipation);
+            }
+            swapSurfaces(velocitySlab);
+        });
+    }
+
+    // Smoke emitter
+    addEmitterPass(r);
+
+    // Buoyancy, curl and vorticity confinement in a single pass
+    if (stepVelocity && (enableBuoyancy || enableVorticityConfinement || computeIntermediateFields)) {
+        frameGraph.addPass("applyForces", { r.temperature, r.density, r.velocity }, { r.velocity, r.curl }, [this]() {
+            dispatchForces(temperatureSlab.ping, densitySlab.ping, velocitySlab.ping, velocitySlab.pong, curlSurface);
+            swapSurfaces(velocitySlab);
+        });
+    }
+
+    // Compute divergence, culled unless the pressure solver reads it
+    frameGraph.addPass("computeDivergence", { r.velocity }, { r.divergence }, [this]() {
+        dispatchDivergence(velocitySlab.ping, divergenceSurface);
+    });
+
+    // Pressure solver
+    if (enablePressureSolver && stepVelocity) {
+        frameGraph.addPass("solvePressure", { r.divergence }, { r.pressure }, [this]() {
+
+            // Reset the pressure field
+            clearSurface(pressureSlab.ping, 0.0f);
+            clearSurface(pressureSlab.pong, 0.0f);
+
+            // Iteratively solve the new pressure field, several iterations per dispatch
+            if (enableMultigrid || enablePackedSolver) {
+                solvePressure();
+            } else {
+                for (int iteration = 0; iteration < jacobiIterations; iteration += COMPUTE_JACOBI_ITERATIONS) {
+                    int iterations = std::min(jacobiIterations - iteration, COMPUTE_JACOBI_ITERATIONS);
+                    dispatchJacobi(divergenceSurface, pressureSlab.ping, pressureSlab.pong, iterations);
+                    swapSurfaces(pressureSlab);
+                }
+            }
+        });
+
+        frameGraph.addPass("applyPressure", { r.pressure, r.velocity }, { r.velocity }, [this]() {
+            dispatchApplyPressure(pressureSlab.ping, velocitySlab.ping, velocitySlab.pong);
+            swapSurfaces(velocitySlab);
+        });
+    }
+
+    // Substep the back trace so the fastest particle stays within the CFL target
+    frameGraph.addPass("updateTraceSubsteps", { r.velocity }, { r.traceSubsteps }, [this, stepVelocity]() {
+        updateTraceSubsteps(enableAdaptiveSubstepping ? reduceMaxSpeed(velocitySlab.ping) : 0.0f);
+        if (stepVelocity) endVelocityStep();
+    });
+
+    // Classify tiles by how much detail they hold
+    if (enableAdaptiveResolution) {
+        frameGraph.addPass("computeTileLevels", { r.density, r.velocity }, { r.tileLevels }, [this]() {
+            computeTileLevels(densitySlab.ping, velocitySlab.ping, tileLevelSurface);
+        });
+    }
+
+    // Advect density and temperature through velocity
+    frameGraph.addPass("advectDensity", { r.velocity, r.traceSubsteps, r.tileLevels, r.density }, { r.density }, [this]() {
+        dispatchAdvectField(velocitySlab.ping, densitySlab, densityLevels, macCormackScalarSlab, densityDissipation);
+        swapSurfaces(densitySlab);
+    });
+
+    frameGraph.addPass("advectTemperature", { r.velocity, r.traceSubsteps, r.tileLevels, r.temperature }, { r.temperature }, [this]() {
+        dispatchAdvectField(velocitySlab.ping, temperatureSlab, temperatureLevels, macCormackScalarSlab, temperatureDissipation);
+        swapSurfaces(temperatureSlab);
+    });
+
+    // Advect rgb through velocity, culled unless a composition shows it, three component textures cannot be bound as images
+    frameGraph.addPass("advectRgb", { r.velocity, r.traceSubsteps, r.tileLevels, r.rgb }, { r.rgb }, [this]() {
+        advectField(velocitySlab.ping, rgbSlab, rgbLevels, macCormackRgbSlab, rgbDissipation);
+        swapSurfaces(rgbSlab);
+    });
+
+    executeFrameGraph(r);
+}
+
+void SmokeSimulation::dispatchAdvect(Surface velocitySurface, Surface source, Surface destination, float dissipation) {
+    GLuint program = advectKernel;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    // Detail is only synthesised for the visual fields, never the velocity itself
+    bool turbulent = enableTurbulence && source.textureHandle != velocitySurface.textureHandle;
+
+    glUniform1i(locations.gridSize, destination.width);
+    glUniform1f(locations.gridSpacing, gridSpacing * GRID_SIZE / destination.width);
+    glUniform1f(locations.dissipation, dissipation);
+    glUniform1i(locations.traceSubsteps, traceSubsteps);
+    glUniform1f(locations.turbulence, turbulent ? turbulenceStrength : 0.0f);
+    glUniform1f(locations.quantization, quantizationStep(destination));
+
+    glState.bindTexture(0, velocitySurface.textureHandle);
+    glState.bindTexture(1, source.textureHandle);
+    bindImage(0, destination, GL_WRITE_ONLY);
+
+    dispatchTiles(destination, COMPUTE_TILE_SIZE);
+}
+
+void SmokeSimulation::dispatchAdvectField(Surface velocitySurface, Slab slab, Levels levels, Slab scratch, float dissipation) {
+
+    // MacCormack correction and adaptive tiles keep their fragment programs
+    if (enableMacCormack || enableAdaptiveResolution) {
+        advectField(velocitySurface, slab, levels, scratch, dissipation);
+    } else {
+        dispatchAdvect(velocitySurface, slab.ping, slab.pong, dissipation);
+    }
+}
+
+void SmokeSimulation::dispatchForces(Surface temperatureSurface, Surface densitySurface, Surface velocitySurface,
+                                     Surface velocityDestination, Surface curlDestination) {
+    GLuint program = applyForcesKernel;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1i(locations.scale, velocityResolution);
+    glUniform1i(locations.buoyancy, enableBuoyancy);
+    glUniform1f(locations.fallForce, fallForce * velocityStepScale());
+    glUniform1f(locations.riseForce, riseForce * velocityStepScale());
+    glUniform1f(locations.atmosphereTemperature, atmosphereTemperature);
+    glUniform1f(locations.gravity, gravity);
+    glUniform1i(locations.vorticityConfinement, enableVorticityConfinement);
+    glUniform1f(locations.vorticityConfinementForce, vorticityConfinementForce);
+
+    glState.bindTexture(0, velocitySurface.textureHandle);
+    glState.bindTexture(1, temperatureSurface.textureHandle);
+    glState.bindTexture(2, densitySurface.textureHandle);
+    bindImage(0, velocityDestination, GL_WRITE_ONLY);
+    bindImage(1, curlDestination, GL_WRITE_ONLY);
+
+    dispatchTiles(velocityDestination, COMPUTE_TILE_SIZE);
+}
+
+void SmokeSimulation::dispatchDivergence(Surface velocitySurface, Surface divergenceSurface) {
+    GLuint program = computeDivergenceKernel;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1f(locations.gradientScale, -((2 * velocityGridSpacing * fluidDensity) / timeStep));
+
+    glState.bindTexture(0, velocitySurface.textureHandle);
+    bindImage(0, divergenceSurface, GL_WRITE_ONLY);
+
+    dispatchTiles(divergenceSurface, COMPUTE_TILE_SIZE);
+}
+
+void SmokeSimulation::dispatchJacobi(Surface divergenceSurface, Surface pressureSource, Surface pressureDestination, int iterations) {
+    GLuint program = jacobiKernel;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1i(locations.iterations, iterations);
+
+    glState.bindTexture(0, divergenceSurface.textureHandle);
+    glState.bindTexture(1, pressureSource.textureHandle);
+    bindImage(0, pressureDestination, GL_WRITE_ONLY);
+
+    dispatchTiles(pressureDestination, COMPUTE_JACOBI_TILE_SIZE);
+}
+
+void SmokeSimulation::dispatchApplyPressure(Surface pressureSurface, Surface velocitySurface, Surface velocityDestination) {
+    GLuint program = applyPressureKernel;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1f(locations.gradientScale, -(timeStep / (2 * fluidDensity * velocityGridSpacing)));
+
+    glState.bindTexture(0, pressureSurface.textureHandle);
+    glState.bindTexture(1, velocitySurface.textureHandle);
+    bindImage(0, velocityDestination, GL_WRITE_ONLY);
+
+    dispatchTiles(velocityDestination, COMPUTE_TILE_SIZE);
+}
@@ -1,123 +1,249 @@
 #include <iostream>
 #include <algorithm>
+#include <cstdint>
+#include <glm/gtc/packing.hpp>
 #include <main.hpp>
 #include <opengl.hpp>
 #include <smoke_simulation/smoke_simulation.hpp>
 
+// Grid access for any field, matching the boundary handling of the member accessors
+template <typename T>
+static T getGridValue(T field[][SmokeSimulation::GRID_SIZE], int size, bool wrapBorders, int i, int j) {
+    if (wrapBorders) {
+        return field[((i % size) + size) % size][((j % size) + size) % size];
+    } else if (i < 0 || j < 0 || i >= size || j >= size) {
+        return T(0.0f);
+    }
+
+    return field[i][j];
+}
+
+template <typename T>
+static T getInterpolatedValue(T field[][SmokeSimulation::GRID_SIZE], int size, bool wrapBorders, float x, float y) {
+    int i = ((int) (x + size)) - size;
+    int j = ((int) (y + size)) - size;
+
+    return (i+1-x) * (j+1-y) * getGridValue(field, size, wrapBorders, i, j) +
+           (x-i) * (j+1-y)   * getGridValue(field, size, wrapBorders, i+1, j) +
+           (i+1-x) * (y-j)   * getGridValue(field, size, wrapBorders, i, j+1) +
+           (x-i) * (y-j)     * getGridValue(field, size, wrapBorders, i+1, j+1);
+}
+
+// Corrects the forward advected field by half the round trip error, limited to the 2x2 source cells the trace
+// interpolates, the same scheme as the GPU programs
+template <typename T>
+static void correctMacCormack(T source[][SmokeSimulation::GRID_SIZE], T advected[][SmokeSimulation::GRID_SIZE], T corrected[][SmokeSimulation::GRID_SIZE],
+                              glm::vec2 trace[][SmokeSimulation::GRID_SIZE], glm::vec2 forwardTrace[][SmokeSimulation::GRID_SIZE],
+                              int size, int stride, float spacing, bool wrapBorders, float dissipation) {
+    #pragma omp parallel for
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            glm::vec2 tracePosition = trace[i * stride][j * stride] / spacing;
+
+            // Step the forward result back along the forward trace
+            glm::vec2 forwardPosition = forwardTrace[i * stride][j * stride] / spacing;
+            T backward = getInterpolatedValue(advected, size, wrapBorders, forwardPosition.x, forwardPosition.y);
+            T value = advected[i][j] + 0.5f * (source[i][j] * dissipation - backward);
+
+            int ti = ((int) (tracePosition.x + size)) - size;
+            int tj = ((int) (tracePosition.y + size)) - size;
+            T minimum = getGridValue(source, size, wrapBorders, ti, tj);
+            T maximum = minimum;
+
+            for (int a = 0; a <= 1; a++) {
+                for (int b = 0; b <= 1; b++) {
+                    T v = getGridValue(source, size, wrapBorders, ti + a, tj + b);
+                    minimum = glm::min(minimum, v);
+                    maximum = glm::max(maximum, v);
+                }
+            }
+
+            corrected[i][j] = glm::clamp(value, minimum * dissipation, maximum * dissipation);
+        }
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            advected[i][j] = corrected[i][j];
+        }
+    }
+}
+
 void SmokeSimulation::initCPU() {
     resetFields();
 
-    // Setup textures for rendering fields
-    glGenTextures(1, &textureA);
-    glBindTexture(GL_TEXTURE_2D, textureA);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Setup pixel buffers for streaming fields to the GPU, the textures are created for the first field shown
+    persistentUploadAvailable = GLEW_ARB_buffer_storage;
+    fieldUploadA = createFieldUpload();
+    fieldUploadB = createFieldUpload();
+    velocityUpload = createFieldUpload();
+    uploadRingIndex = 0;
+}
+
+SmokeSimulation::FieldUpload SmokeSimulation::createFieldUpload() {
+    FieldUpload upload;
+    upload.texture = 0;
+    upload.numComponents = 0;
+
+    // Room for the widest field, three half floats per cell
+    GLsizeiptr size = GRID_SIZE * GRID_SIZE * 3 * sizeof(GLhalf);
+    glGenBuffers(UPLOAD_RING_SIZE, upload.pixelBuffers);
+
+    for (int i = 0; i < UPLOAD_RING_SIZE; i++) {
+        upload.mappedPixels[i] = NULL;
+        upload.fences[i] = 0;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pixelBuffers[i]);
+
+        if (persistentUploadAvailable) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+            upload.mappedPixels[i] = (GLhalf*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
-    glGenTextures(1, &textureB);
-    glBindTexture(GL_TEXTURE_2D, textureB);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return upload;
 }
 
 void SmokeSimulation::resetFields() {
+    resetVelocityFields();
+
     for (int i = 0; i < GRID_SIZE; i++) {
         for (int j = 0; j < GRID_SIZE; j++) {
-            velocity[i][j] = glm::vec2(0.0f, 0.0f);
-            advectedVelocity[i][j] = glm::vec2(0.0f, 0.0f);
-            divergence[i][j] = 0.0f;
-            pressure[i][j] = 0.0f;
-            newPressure[i][j] = 0.0f;
             density[i][j] = 0.0f;
             advectedDensity[i][j] = 0.0f;
             temperature[i][j] = atmosphereTemperature;
             advectedTemperatue[i][j] = atmosphereTemperature;
             tracePosition[i][j] = glm::vec2(0.0f, 0.0f);
-            curl[i][j] = 0.0f;
+            turbulentTracePosition[i][j] = glm::vec2(0.0f, 0.0f);
+            forwardTracePosition[i][j] = glm::vec2(0.0f, 0.0f);
             rgb[i][j] = glm::vec3(0.0f, 0.0f, 0.0f);
             advectedRgb[i][j] = glm::vec3(0.0f, 0.0f, 0.0f);
         }
     }
 }
 
-void SmokeSimulation::updateCPU() {
-
-    // Advect velocity through velocity
-    #pragma omp parallel for
+void SmokeSimulation::resetVelocityFields() {
     for (int i = 0; i < GRID_SIZE; i++) {
         for (int j = 0; j < GRID_SIZE; j++) {
-            advectedVelocity[i][j] = getVelocity(tracePosition[i][j].x, tracePosition[i][j].y) * velocityDissipation;
+            velocity[i][j] = glm::vec2(0.0f, 0.0f);
+            advectedVelocity[i][j] = glm::vec2(0.0f, 0.0f);
+            divergence[i][j] = 0.0f;
+            pressure[i][j] = 0.0f;
+            newPressure[i][j] = 0.0f;
+            curl[i][j] = 0.0f;
         }
     }
+}
 
-    #pragma omp parallel for
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            velocity[i][j] = advectedVelocity[i][j];
+void SmokeSimulation::updateCPU() {
+    int scale = velocityResolution;
+
+    bool stepVelocity = updatesVelocity();
+
+    // Step the velocity and the forces on it over the whole interval since the last update
+    float stepScale = velocityStepScale();
+
+    // Advect velocity through velocity, velocity cells coincide with every scale'th trace position
+    if (stepVelocity) {
+
+        // The stored trace only covers one frame, so longer intervals trace the velocity cells again
+        if (velocityUpdateInterval > 1) {
+            updateTraceSubsteps(lastMaxSpeed, stepScale);
+
+            #pragma omp parallel for
+            for (int i = 0; i < velocityGridSize; i++) {
+                for (int j = 0; j < velocityGridSize; j++) {
+                    tracePosition[i * scale][j * scale] = traceParticle(i * velocityGridSpacing, j * velocityGridSpacing, timeStep * stepScale);
+                }
+            }
         }
-    }
 
-    // Smoke emitter
-    if (enableEmitter) {
-        glm::vec2 position = glm::vec2(GRID_SIZE / 2 * SCREEN_WIDTH / GRID_SIZE, GRID_SIZE * SCREEN_HEIGHT / GRID_SIZE - 2);
-        glm::vec2 force = glm::vec2(myRandom() * pulseForce - pulseForce / 2.0f, -pulseForce);
+        float dissipation = powf(velocityDissipation, stepScale);
+
+        #pragma omp parallel for
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                glm::vec2 trace = tracePosition[i * scale][j * scale];
+                advectedVelocity[i][j] = getVelocity(trace.x, trace.y) * dissipation;
+            }
+        }
 
-        emitCPU(position, emitterRange,
-                std::vector<Display>{ VELOCITY, DENSITY, TEMPERATURE },
-                std::vector<glm::vec3>{ glm::vec3(force, 0.0f), glm::vec3(0.2f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) }
-        );
+        if (enableMacCormack) {
+            #pragma omp parallel for
+            for (int i = 0; i < velocityGridSize; i++) {
+                for (int j = 0; j < velocityGridSize; j++) {
+                    forwardTracePosition[i * scale][j * scale] = traceParticle(i * velocityGridSpacing, j * velocityGridSpacing, -timeStep * stepScale);
+                }
+            }
+
+            correctMacCormack(velocity, advectedVelocity, correctedVelocity, tracePosition, forwardTracePosition,
+                              velocityGridSize, scale, velocityGridSpacing, wrapBorders, dissipation);
+        }
+
+        #pragma omp parallel for
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                velocity[i][j] = advectedVelocity[i][j];
+            }
+        }
     }
 
+    // Smoke emitter
+    if (enableEmitter) applyEmitter();
+
     // Buoyancy
-    if (enableBuoyancy) {
+    if (enableBuoyancy && stepVelocity) {
         #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                velocity[i][j] += buoyancyForceAt(i, j);
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                velocity[i][j] += buoyancyForceAt(i, j) * stepScale;
             }
         }
     }
 
     // Compute curl
-    if (enableVorticityConfinement || computeIntermediateFields) {
+    if (stepVelocity && (enableVorticityConfinement || computeIntermediateFields)) {
         #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
                 curl[i][j] = curlAt(i, j);
             }
         }
     }
 
     // Apply vorticity confinement
-    if (enableVorticityConfinement) {
+    if (enableVorticityConfinement && stepVelocity) {
         #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                velocity[i][j] += vorticityConfinementForceAt(i, j);
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                velocity[i][j] += vorticityConfinementForceAt(i, j) * stepScale;
             }
         }
     }
 
     // Compute divergence
-    if (enablePressureSolver || computeIntermediateFields) {
+    if (stepVelocity && (enablePressureSolver || computeIntermediateFields)) {
         #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
                 divergence[i][j] = divergenceAt(i, j);
             }
         }
     }
 
     // Pressure solver
-    if (enablePressureSolver) {
+    if (enablePressureSolver && stepVelocity) {
 
         // Reset the pressure field
         #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
                 pressure[i][j] = 0.0f;
             }
         }
@@ -125,28 +251,28 @@ void SmokeSimulation::updateCPU() {
         // Iteratively solve the new pressure field
         for (int iteration = 0; iteration < jacobiIterations; iteration++) {
             #pragma omp parallel for
-            for (int i = 0; i < GRID_SIZE; i++) {
-                for (int j = 0; j < GRID_SIZE; j++) {
+            for (int i = 0; i < velocityGridSize; i++) {
+                for (int j = 0; j < velocityGridSize; j++) {
                     newPressure[i][j] = pressureAt(i, j);
                 }
             }
 
             #pragma omp parallel for
-            for (int i = 0; i < GRID_SIZE; i++) {
-                for (int j = 0; j < GRID_SIZE; j++) {
+            for (int i = 0; i < velocityGridSize; i++) {
+                for (int j = 0; j < velocityGridSize; j++) {
                     pressure[i][j] = newPressure[i][j];
                 }
             }
         }
 
-        float a = -(timeStep / (2 * fluidDensity * gridSpacing));
+        float a = -(timeStep / (2 * fluidDensity * velocityGridSpacing));
 
         // Apply pressure
         #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                float xChange = getGridPressure(clampIndex(i + 1), j) - getGridPressure(clampIndex(i - 1), j);
-                float yChange = getGridPressure(i, clampIndex(j + 1)) - getGridPressure(i, clampIndex(j - 1));
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                float xChange = getGridPressure(clampIndex(i + 1, velocityGridSize), j) - getGridPressure(clampIndex(i - 1, velocityGridSize), j);
+                float yChange = getGridPressure(i, clampIndex(j + 1, velocityGridSize)) - getGridPressure(i, clampIndex(j - 1, velocityGridSize));
 
                 velocity[i][j].x += a * xChange;
                 velocity[i][j].y += a * yChange;
@@ -154,20 +280,105 @@ void SmokeSimulation::updateCPU() {
         }
     }
 
-    // Compute the trace position
-    #pragma omp parallel for
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            tracePosition[i][j] = traceParticle(i * gridSpacing, j * gridSpacing);
+    // Substep the back trace so the fastest particle stays within the CFL target
+    float maxSpeed = 0.0f;
+
+    if (enableAdaptiveSubstepping) {
+        #pragma omp parallel for reduction(max: maxSpeed)
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                maxSpeed = std::max(maxSpeed, glm::length(velocity[i][j]));
+            }
         }
     }
 
-    // Advect density and temperature through velocity
-    #pragma omp parallel for
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            advectedDensity[i][j] = getDensity(tracePosition[i][j].x, tracePosition[i][j].y) * densityDissipation;
-            advectedTemperatue[i][j] = getTemperature(tracePosition[i][j].x, tracePosition[i][j].y) * temperatureDissipation;
+    updateTraceSubsteps(maxSpeed);
+
+    bool advectRgb = std::find(compositionFields.begin(), compositionFields.end(), RGB) != compositionFields.end();
+
+    if (enableAdaptiveResolution) {
+        updateTileLevels();
+
+        // Only velocity cells keep a stored trace, the tiles trace their own samples
+        #pragma omp parallel for
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                tracePosition[i * scale][j * scale] = traceParticle(i * velocityGridSpacing, j * velocityGridSpacing, timeStep);
+            }
+        }
+
+        advectTilesCPU(advectRgb);
+    } else {
+        // Compute the trace position
+        #pragma omp parallel for
+        for (int i = 0; i < GRID_SIZE; i++) {
+            for (int j = 0; j < GRID_SIZE; j++) {
+                tracePosition[i][j] = traceParticle(i * gridSpacing, j * gridSpacing, timeStep);
+            }
+        }
+
+        // Perturb the visual fields trace with detail the velocity grid can't resolve
+        glm::vec2 (*dyeTracePosition)[GRID_SIZE] = tracePosition;
+
+        if (enableTurbulence) {
+            #pragma omp parallel for
+            for (int i = 0; i < GRID_SIZE; i++) {
+                for (int j = 0; j < GRID_SIZE; j++) {
+                    glm::vec2 position = glm::vec2(i * gridSpacing, j * gridSpacing);
+                    float speed = glm::distance(position, tracePosition[i][j]) / timeStep;
+                    turbulentTracePosition[i][j] = tracePosition[i][j] - timeStep * turbulenceAt(position.x, position.y, speed);
+                }
+            }
+
+            dyeTracePosition = turbulentTracePosition;
+        }
+
+        // Advect density and temperature through velocity
+        #pragma omp parallel for
+        for (int i = 0; i < GRID_SIZE; i++) {
+            for (int j = 0; j < GRID_SIZE; j++) {
+                advectedDensity[i][j] = getDensity(dyeTracePosition[i][j].x, dyeTracePosition[i][j].y) * densityDissipation;
+                advectedTemperatue[i][j] = getTemperature(dyeTracePosition[i][j].x, dyeTracePosition[i][j].y) * temperatureDissipation;
+            }
+        }
+
+        // Advect rgb through velocity if enabled
+        if (advectRgb) {
+            #pragma omp parallel for
+            for (int i = 0; i < GRID_SIZE; i++) {
+                for (int j = 0; j < GRID_SIZE; j++) {
+                    advectedRgb[i][j] = getRgb(dyeTracePosition[i][j].x, dyeTracePosition[i][j].y) * rgbDissipation;
+                }
+            }
+        }
+
+        if (enableMacCormack) {
+
+            // Trace forwards through the same flow and detail as the back trace
+            #pragma omp parallel for
+            for (int i = 0; i < GRID_SIZE; i++) {
+                for (int j = 0; j < GRID_SIZE; j++) {
+                    glm::vec2 position = glm::vec2(i * gridSpacing, j * gridSpacing);
+                    glm::vec2 forward = traceParticle(position.x, position.y, -timeStep);
+
+                    if (enableTurbulence) {
+                        float speed = glm::distance(position, forward) / timeStep;
+                        forward += timeStep * turbulenceAt(position.x, position.y, speed);
+                    }
+
+                    forwardTracePosition[i][j] = forward;
+                }
+            }
+
+            correctMacCormack(density, advectedDensity, correctedDensity, dyeTracePosition, forwardTracePosition,
+                              GRID_SIZE, 1, gridSpacing, wrapBorders, densityDissipation);
+            correctMacCormack(temperature, advectedTemperatue, correctedTemperature, dyeTracePosition, forwardTracePosition,
+                              GRID_SIZE, 1, gridSpacing, wrapBorders, temperatureDissipation);
+
+            if (advectRgb) {
+                correctMacCormack(rgb, advectedRgb, correctedRgb, dyeTracePosition, forwardTracePosition,
+                                  GRID_SIZE, 1, gridSpacing, wrapBorders, rgbDissipation);
+            }
         }
     }
 
@@ -179,15 +390,7 @@ void SmokeSimulation::updateCPU() {
         }
     }
 
-    // Advect rgb through velocity if enabled
-    if (std::find(compositionFields.begin(), compositionFields.end(), RGB) != compositionFields.end()) {
-        #pragma omp parallel for
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                advectedRgb[i][j] = getRgb(tracePosition[i][j].x, tracePosition[i][j].y) * rgbDissipation;
-            }
-        }
-
+    if (advectRgb) {
         #pragma omp parallel for
         for (int i = 0; i < GRID_SIZE; i++) {
             for (int j = 0; j < GRID_SIZE; j++) {
@@ -200,6 +403,25 @@ void SmokeSimulation::updateCPU() {
 void SmokeSimulation::emitCPU(glm::vec2 position, float range, std::vector<Display> fields, std::vector<glm::vec3> values) {
     position *= windowToGrid;
 
+    // Velocity lives on its own grid and only takes the impulse, scaled to the interval, when it is stepped
+    float velocityScale = velocityStepScale();
+
+    for (size_t field = 0; field < fields.size(); field++) {
+        if (fields[field] != VELOCITY || !updatesVelocity()) continue;
+
+        #pragma omp parallel for
+        for (int i = 0; i < velocityGridSize; i++) {
+            for (int j = 0; j < velocityGridSize; j++) {
+                glm::vec2 gridPosition = glm::vec2(i * velocityGridSpacing, j * velocityGridSpacing);
+                float distance = glm::distance(position, gridPosition);
+
+                if (distance < range) {
+                    velocity[i][j] += glm::vec2(values[field]) * velocityScale * (1.0f - distance / range);
+                }
+            }
+        }
+    }
+
     #pragma omp parallel for
     for (int i = 0; i < GRID_SIZE; i++) {
         for (int j = 0; j < GRID_SIZE; j++) {
@@ -214,9 +436,6 @@ void SmokeSimulation::emitCPU(glm::vec2 position, float range, std::vector<Displ
                         case DENSITY:
                             density[i][j] += values[field].x * falloff;
                             break;
-                        case VELOCITY:
-                            velocity[i][j] += glm::vec2(values[field]) * falloff;
-                            break;
                         case TEMPERATURE:
                             temperature[i][j] += values[field].x * falloff;
                             break;
@@ -232,25 +451,175 @@ void SmokeSimulation::emitCPU(glm::vec2 position, float range, std::vector<Displ
     }
 }
 
-glm::vec2 SmokeSimulation::traceParticle(float x, float y) {
-    glm::vec2 v = getVelocity(x, y);
-    v = getVelocity(x + 0.5f * timeStep * v.x, y + 0.5f * timeStep * v.y);
-    return glm::vec2(x, y) - (timeStep * v);
+glm::vec2 SmokeSimulation::traceParticle(float x, float y, float step) {
+    glm::vec2 position = glm::vec2(x, y);
+    float dt = step / traceSubsteps;
+
+    for (int step = 0; step < traceSubsteps; step++) {
+        glm::vec2 v = getVelocity(position.x, position.y);
+        v = getVelocity(position.x + 0.5f * dt * v.x, position.y + 0.5f * dt * v.y);
+        position -= dt * v;
+    }
+
+    return position;
+}
+
+static float hash(int x, int y, int z) {
+    uint32_t h = ((uint32_t) x * 73856093u) ^ ((uint32_t) y * 19349663u) ^ ((uint32_t) z * 83492791u);
+    h = (h ^ (h >> 13u)) * 1274126177u;
+    h = h ^ (h >> 16u);
+    return (h & 0xffffu) / 65535.0f;
+}
+
+static float noise(glm::vec3 p) {
+    glm::vec3 floored = glm::floor(p);
+    int x = (int) floored.x;
+    int y = (int) floored.y;
+    int z = (int) floored.z;
+    glm::vec3 f = p - floored;
+    glm::vec3 u = f * f * (3.0f - 2.0f * f);
+
+    return glm::mix(glm::mix(glm::mix(hash(x, y, z), hash(x + 1, y, z), u.x),
+                             glm::mix(hash(x, y + 1, z), hash(x + 1, y + 1, z), u.x), u.y),
+                    glm::mix(glm::mix(hash(x, y, z + 1), hash(x + 1, y, z + 1), u.x),
+                             glm::mix(hash(x, y + 1, z + 1), hash(x + 1, y + 1, z + 1), u.x), u.y), u.z);
+}
+
+glm::vec2 SmokeSimulation::turbulenceAt(float x, float y, float speed) {
+    float frequency = 1.0f / (turbulenceScale * gridSpacing);
+    glm::vec3 p = glm::vec3(x * frequency, y * frequency, turbulenceTime);
+    float e = 0.1f;
+
+    float dx = noise(p + glm::vec3(e, 0.0f, 0.0f)) - noise(p - glm::vec3(e, 0.0f, 0.0f));
+    float dy = noise(p + glm::vec3(0.0f, e, 0.0f)) - noise(p - glm::vec3(0.0f, e, 0.0f));
+
+    // Curl of the noise potential keeps the detail divergence free
+    return turbulenceStrength * speed * glm::vec2(dy, -dx) / (2.0f * e);
+}
+
+void SmokeSimulation::updateTileLevels() {
+    int scale = velocityResolution;
+    int velocityTileSize = std::max(TILE_SIZE / scale, 1);
+    float rotationScale = timeStep / velocityGridSpacing;
+
+    #pragma omp parallel for collapse(2)
+    for (int ti = 0; ti < NUM_TILES; ti++) {
+        for (int tj = 0; tj < NUM_TILES; tj++) {
+            float detail = 0.0f;
+
+            // Steep density edges hold the visible structure
+            for (int i = ti * TILE_SIZE; i < (ti + 1) * TILE_SIZE; i++) {
+                for (int j = tj * TILE_SIZE; j < (tj + 1) * TILE_SIZE; j++) {
+                    float xChange = getGridDensity(clampIndex(i + 1, GRID_SIZE), j) - getGridDensity(clampIndex(i - 1, GRID_SIZE), j);
+                    float yChange = getGridDensity(i, clampIndex(j + 1, GRID_SIZE)) - getGridDensity(i, clampIndex(j - 1, GRID_SIZE));
+                    detail = std::max(detail, 0.5f * std::max(std::abs(xChange), std::abs(yChange)));
+                }
+            }
+
+            // Rotation per time step of the velocity cells covering the tile
+            for (int i = ti * TILE_SIZE / scale; i < ti * TILE_SIZE / scale + velocityTileSize; i++) {
+                for (int j = tj * TILE_SIZE / scale; j < tj * TILE_SIZE / scale + velocityTileSize; j++) {
+                    detail = std::max(detail, std::abs(curlAt(i, j)) * rotationScale);
+                }
+            }
+
+            if (detail >= refinementThreshold) {
+                tileLevels[ti][tj] = FULL;
+            } else if (detail >= refinementThreshold * 0.25f) {
+                tileLevels[ti][tj] = HALF;
+            } else {
+                tileLevels[ti][tj] = QUARTER;
+            }
+        }
+    }
+}
+
+void SmokeSimulation::advectTilesCPU(bool advectRgb) {
+    #pragma omp parallel for collapse(2)
+    for (int ti = 0; ti < NUM_TILES; ti++) {
+        for (int tj = 0; tj < NUM_TILES; tj++) {
+            int level = tileLevels[ti][tj];
+            int samples = TILE_SIZE / level + 1;
+
+            float sampledDensity[TILE_SIZE + 1][TILE_SIZE + 1];
+            float sampledTemperature[TILE_SIZE + 1][TILE_SIZE + 1];
+            glm::vec3 sampledRgb[TILE_SIZE + 1][TILE_SIZE + 1];
+
+            // Advect every level'th cell of the tile, including the first cells of the neighbouring tiles
+            for (int a = 0; a < samples; a++) {
+                for (int b = 0; b < samples; b++) {
+                    int i = std::min(ti * TILE_SIZE + a * level, GRID_SIZE - 1);
+                    int j = std::min(tj * TILE_SIZE + b * level, GRID_SIZE - 1);
+
+                    glm::vec2 position = glm::vec2(i * gridSpacing, j * gridSpacing);
+                    glm::vec2 trace = traceParticle(position.x, position.y, timeStep);
+
+                    if (enableTurbulence) {
+                        float speed = glm::distance(position, trace) / timeStep;
+                        trace -= timeStep * turbulenceAt(position.x, position.y, speed);
+                    }
+
+                    sampledDensity[a][b] = getDensity(trace.x, trace.y) * densityDissipation;
+                    sampledTemperature[a][b] = getTemperature(trace.x, trace.y) * temperatureDissipation;
+                    if (advectRgb) sampledRgb[a][b] = getRgb(trace.x, trace.y) * rgbDissipation;
+                }
+            }
+
+            // Fill the rest of the tile by bilinear interpolation of the samples
+            for (int x = 0; x < TILE_SIZE; x++) {
+                for (int y = 0; y < TILE_SIZE; y++) {
+                    int a = x / level;
+                    int b = y / level;
+
+                    int i = ti * TILE_SIZE + x;
+                    int j = tj * TILE_SIZE + y;
+
+                    // Weight by the cells actually sampled, the last samples of the grid are clamped closer
+                    int i0 = ti * TILE_SIZE + a * level;
+                    int j0 = tj * TILE_SIZE + b * level;
+                    int i1 = std::min(i0 + level, GRID_SIZE - 1);
+                    int j1 = std::min(j0 + level, GRID_SIZE - 1);
+                    float s = i1 > i0 ? (float) (i - i0) / (i1 - i0) : 0.0f;
+                    float t = j1 > j0 ? (float) (j - j0) / (j1 - j0) : 0.0f;
+
+                    if (level == FULL) {
+                        advectedDensity[i][j] = sampledDensity[a][b];
+                        advectedTemperatue[i][j] = sampledTemperature[a][b];
+                        if (advectRgb) advectedRgb[i][j] = sampledRgb[a][b];
+                        continue;
+                    }
+
+                    advectedDensity[i][j] = glm::mix(glm::mix(sampledDensity[a][b], sampledDensity[a + 1][b], s),
+                                                     glm::mix(sampledDensity[a][b + 1], sampledDensity[a + 1][b + 1], s), t);
+                    advectedTemperatue[i][j] = glm::mix(glm::mix(sampledTemperature[a][b], sampledTemperature[a + 1][b], s),
+                                                        glm::mix(sampledTemperature[a][b + 1], sampledTemperature[a + 1][b + 1], s), t);
+                    if (advectRgb) {
+                        advectedRgb[i][j] = glm::mix(glm::mix(sampledRgb[a][b], sampledRgb[a + 1][b], s),
+                                                     glm::mix(sampledRgb[a][b + 1], sampledRgb[a + 1][b + 1], s), t);
+                    }
+                }
+            }
+        }
+    }
 }
 
 float SmokeSimulation::divergenceAt(int i, int j) {
-    float a = -((2 * gridSpacing * fluidDensity) / timeStep);
+    float a = -((2 * velocityGridSpacing * fluidDensity) / timeStep);
 
-    float b = getVelocity((i + 1) * gridSpacing, j * gridSpacing).x -
-              getVelocity((i - 1) * gridSpacing, j * gridSpacing).x +
-              getVelocity(i * gridSpacing, (j + 1) * gridSpacing).y -
-              getVelocity(i * gridSpacing, (j - 1) * gridSpacing).y;
+    float b = getVelocity((i + 1) * velocityGridSpacing, j * velocityGridSpacing).x -
+              getVelocity((i - 1) * velocityGridSpacing, j * velocityGridSpacing).x +
+              getVelocity(i * velocityGridSpacing, (j + 1) * velocityGridSpacing).y -
+              getVelocity(i * velocityGridSpacing, (j - 1) * velocityGridSpacing).y;
 
     return a * b;
 }
 
 glm::vec2 SmokeSimulation::buoyancyForceAt(int i, int j) {
-    return (fallForce * density[i][j] - riseForce * (temperature[i][j] - atmosphereTemperature)) * glm::vec2(0.0f, gravity / abs(gravity));
+    int scale = velocityResolution;
+    float d = density[i * scale][j * scale];
+    float t = temperature[i * scale][j * scale];
+
+    return (fallForce * d - riseForce * (t - atmosphereTemperature)) * glm::vec2(0.0f, gravity / abs(gravity));
 }
 
 float SmokeSimulation::curlAt(int i, int j) {
@@ -282,16 +651,16 @@ glm::vec2 SmokeSimulation::vorticityConfinementForceAt(int i, int j) {
 
 float SmokeSimulation::pressureAt(int i, int j) {
     float d = divergence[i][j];
-    float p = getGridPressure(clampIndex(i + 2), j) +
-              getGridPressure(clampIndex(i - 2), j) +
-              getGridPressure(i, clampIndex(j + 2)) +
-              getGridPressure(i, clampIndex(j - 2));
+    float p = getGridPressure(clampIndex(i + 2, velocityGridSize), j) +
+              getGridPressure(clampIndex(i - 2, velocityGridSize), j) +
+              getGridPressure(i, clampIndex(j + 2, velocityGridSize)) +
+              getGridPressure(i, clampIndex(j - 2, velocityGridSize));
     return (d + p) * 0.25f;
 }
 
 glm::vec2 SmokeSimulation::getVelocity(float x, float y) {
-    float normX = x / gridSpacing;
-    float normY = y / gridSpacing;
+    float normX = x / velocityGridSpacing;
+    float normY = y / velocityGridSpacing;
 
     glm::vec2 v = glm::vec2();
 
@@ -367,135 +736,186 @@ glm::vec3 SmokeSimulation::getInterpolatedRgb(float x, float y) {
 
 glm::vec2 SmokeSimulation::getGridVelocity(int i, int j) {
     if (wrapBorders) {
-        return velocity[wrapIndex(i)][wrapIndex(j)];
+        return velocity[wrapIndex(i, velocityGridSize)][wrapIndex(j, velocityGridSize)];
     } else {
-        bool boundary = clampBoundary(i) || clampBoundary(j);
+        bool boundary = clampBoundary(i, velocityGridSize) || clampBoundary(j, velocityGridSize);
         return velocity[i][j] * (boundary ? 0.0f : 1.0f);
     }
 }
 
 float SmokeSimulation::getGridDensity(int i, int j) {
     if (wrapBorders) {
-        return density[wrapIndex(i)][wrapIndex(j)];
+        return density[wrapIndex(i, GRID_SIZE)][wrapIndex(j, GRID_SIZE)];
     } else {
-        bool boundary = clampBoundary(i) || clampBoundary(j);
+        bool boundary = clampBoundary(i, GRID_SIZE) || clampBoundary(j, GRID_SIZE);
         return density[i][j] * (boundary ? 0.0f : 1.0f);
     }
 }
 
 float SmokeSimulation::getGridTemperature(int i, int j) {
     if (wrapBorders) {
-        return temperature[wrapIndex(i)][wrapIndex(j)];
+        return temperature[wrapIndex(i, GRID_SIZE)][wrapIndex(j, GRID_SIZE)];
     } else {
-        bool boundary = clampBoundary(i) || clampBoundary(j);
+        bool boundary = clampBoundary(i, GRID_SIZE) || clampBoundary(j, GRID_SIZE);
         return temperature[i][j] * (boundary ? 0.0f : 1.0f);
     }
 }
 
 float SmokeSimulation::getGridPressure(int i, int j) {
     if (wrapBorders) {
-        return pressure[wrapIndex(i)][wrapIndex(j)];
+        return pressure[wrapIndex(i, velocityGridSize)][wrapIndex(j, velocityGridSize)];
     } else {
-        bool boundary = clampBoundary(i) || clampBoundary(j);
+        bool boundary = clampBoundary(i, velocityGridSize) || clampBoundary(j, velocityGridSize);
         return pressure[i][j] * (boundary ? 0.0f : 1.0f);
     }
 }
 
 float SmokeSimulation::getGridCurl(int i, int j) {
     if (wrapBorders) {
-        return curl[wrapIndex(i)][wrapIndex(j)];
+        return curl[wrapIndex(i, velocityGridSize)][wrapIndex(j, velocityGridSize)];
     } else {
-        bool boundary = clampBoundary(i) || clampBoundary(j);
+        bool boundary = clampBoundary(i, velocityGridSize) || clampBoundary(j, velocityGridSize);
         return curl[i][j] * (boundary ? 0.0f : 1.0f);
     }
 }
 
 glm::vec3 SmokeSimulation::getGridRgb(int i, int j) {
     if (wrapBorders) {
-        return rgb[wrapIndex(i)][wrapIndex(j)];
+        return rgb[wrapIndex(i, GRID_SIZE)][wrapIndex(j, GRID_SIZE)];
     } else {
-        bool boundary = clampBoundary(i) || clampBoundary(j);
+        bool boundary = clampBoundary(i, GRID_SIZE) || clampBoundary(j, GRID_SIZE);
         return rgb[i][j] * (boundary ? 0.0f : 1.0f);
     }
 }
 
-int SmokeSimulation::wrapIndex(int i) {
-    if (i < 0) i = GRID_SIZE + (i % GRID_SIZE);
-    else i = i >= GRID_SIZE ? i % GRID_SIZE : i;
+int SmokeSimulation::wrapIndex(int i, int size) {
+    if (i < 0) i = size + (i % size);
+    else i = i >= size ? i % size : i;
 
     return i;
 }
 
-bool SmokeSimulation::clampBoundary(int &i) {
+bool SmokeSimulation::clampBoundary(int &i, int size) {
     if (i < 0) {
         i = 0;
         return true;
-    }  else if (i >= GRID_SIZE) {
-        i = GRID_SIZE - 1;
+    }  else if (i >= size) {
+        i = size - 1;
         return true;
     }
 
     return false;
 }
 
-int SmokeSimulation::clampIndex(int i) {
+int SmokeSimulation::clampIndex(int i, int size) {
     if (i < 0 && !wrapBorders) {
         return 0;
-    }  else if (i >= GRID_SIZE && !wrapBorders) {
-        return GRID_SIZE - 1;
+    }  else if (i >= size && !wrapBorders) {
+        return size - 1;
     }
 
     return i;
 }
 
 void SmokeSimulation::renderCPU() {
+    if (currentDisplay == COMPOSITION) {
+        streamFieldIntoTexture(fieldUploadA, compositionFields[0]);
+        streamFieldIntoTexture(fieldUploadB, compositionFields[1]);
+    } else {
+        streamFieldIntoTexture(fieldUploadA, currentDisplay);
+    }
+
+    glState.bindTexture(0, fieldUploadA.texture);
+
+    glState.bindTexture(1, currentDisplay == COMPOSITION ? fieldUploadB.texture : 0);
+}
+
+void SmokeSimulation::streamFieldIntoTexture(FieldUpload &upload, Display display) {
+    int numComponents = componentsForDisplayCPU(display);
+    GLenum format = formatFor(numComponents);
+
+    // Only the channels the field needs are stored, so the texture is recreated when that changes
+    if (upload.numComponents != numComponents) {
+        glDeleteTextures(1, &upload.texture);
+        glState.invalidate();
+
+        glGenTextures(1, &upload.texture);
+        glState.bindTexture(0, upload.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        GLenum internalFormat = internalFormatFor(numComponents, FLOAT16);
+        if (GLEW_ARB_texture_storage) {
+            glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, GRID_SIZE, GRID_SIZE);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, GRID_SIZE, GRID_SIZE, 0, format, GL_HALF_FLOAT, 0);
+        }
+
+        upload.numComponents = numComponents;
+    }
+
+    int slot = uploadRingIndex;
+    GLsizeiptr size = GRID_SIZE * GRID_SIZE * numComponents * sizeof(GLhalf);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pixelBuffers[slot]);
+
+    GLhalf *pixels = upload.mappedPixels[slot];
+    if (pixels) {
+
+        // Wait for the upload that last read this buffer, normally finished frames ago
+        if (upload.fences[slot]) {
+            while (glClientWaitSync(upload.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(upload.fences[slot]);
+            upload.fences[slot] = 0;
+        }
+    } else {
+        pixels = (GLhalf*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    // The worker threads convert straight into the buffer, rows of the texture are columns of the fields
     #pragma omp parallel for
     for (int i = 0; i < GRID_SIZE; i++) {
         for (int j = 0; j < GRID_SIZE; j++) {
-            textureFieldA[i][j] = glm::vec3();
-            textureFieldB[i][j] = glm::vec3();
-
-            switch (currentDisplay) {
-                case COMPOSITION:
-                    textureFieldA[i][j] = dataForDisplayCPU(compositionFields[0], j, i);
-                    textureFieldB[i][j] = dataForDisplayCPU(compositionFields[1], j, i);
-                    break;
-                case DENSITY:
-                    textureFieldA[i][j].r = density[j][i];
-                    break;
-                case VELOCITY:
-                    textureFieldA[i][j].r = velocity[j][i].x;
-                    textureFieldA[i][j].g = velocity[j][i].y;
-                    break;
-                case TEMPERATURE:
-                    textureFieldA[i][j].r = temperature[j][i];
-                    break;
-                case CURL:
-                    textureFieldA[i][j].r = curl[j][i];
-                    break;
-                default:
-                    break;
+            glm::vec3 value = dataForDisplayCPU(display, j, i);
+            GLhalf *texel = pixels + (i * GRID_SIZE + j) * numComponents;
+
+            for (int c = 0; c < numComponents; c++) {
+                texel[c] = glm::packHalf1x16(value[c]);
             }
         }
     }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureA);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, GRID_SIZE, GRID_SIZE, 0, GL_RGB, GL_FLOAT, &textureFieldA[0]);
+    if (!upload.mappedPixels[slot]) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textureB);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, GRID_SIZE, GRID_SIZE, 0, GL_RGB, GL_FLOAT, &textureFieldB[0]);
+    glState.bindTexture(0, upload.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GRID_SIZE, GRID_SIZE, format, GL_HALF_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (upload.mappedPixels[slot]) upload.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+int SmokeSimulation::componentsForDisplayCPU(Display display) {
+    switch (display) {
+        case VELOCITY:
+            return 2;
+        case RGB:
+            return 3;
+        default:
+            return 1;
+    }
 }
 
 glm::vec3 SmokeSimulation::dataForDisplayCPU(Display display, int i, int j) {
     switch (display) {
         case DENSITY:
             return glm::vec3(density[i][j], 0, 0);
+        case VELOCITY:
+            return glm::vec3(velocity[i / velocityResolution][j / velocityResolution], 0);
         case TEMPERATURE:
             return glm::vec3(temperature[i][j], 0, 0);
         case CURL:
-            return glm::vec3(curl[i][j], 0, 0);
+            return glm::vec3(curl[i / velocityResolution][j / velocityResolution], 0, 0);
         case RGB:
             return rgb[i][j];
         default:
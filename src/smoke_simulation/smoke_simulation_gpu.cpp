@@ -9,63 +9,252 @@ void SmokeSimulation::initGPU() {
     initPrograms();
     initSlabs();
 
-    // Setup samplers for bounded vs border wrapping
-    GLuint boundedSampler;
+    // Per frame constants are shared by every program through one uniform buffer
+    glGenBuffers(1, &frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    updateFrameUniforms();
+
+    // Setup samplers for bounded vs border wrapping, bilinear lookups past a bounded edge read zero
+    float border[] = { 0.0f, 0.0f, 0.0f, 0.0f };
     glGenSamplers(1, &boundedSampler);
-    glSamplerParameteri(boundedSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glSamplerParameteri(boundedSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(boundedSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glSamplerParameteri(boundedSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glSamplerParameterfv(boundedSampler, GL_TEXTURE_BORDER_COLOR, border);
     glSamplerParameteri(boundedSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glSamplerParameteri(boundedSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    GLuint wrapBordersSampler;
     glGenSamplers(1, &wrapBordersSampler);
-    glSamplerParameteri(wrapBordersSampler, GL_TEXTURE_WRAP_S, GL_WRAP_BORDER);
-    glSamplerParameteri(wrapBordersSampler, GL_TEXTURE_WRAP_T, GL_WRAP_BORDER);
+    glSamplerParameteri(wrapBordersSampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glSamplerParameteri(wrapBordersSampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glSamplerParameteri(wrapBordersSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glSamplerParameteri(wrapBordersSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    updateSampler();
 }
 
 void SmokeSimulation::initPrograms() {
-    advectProgram = loadShaders("programs/vertexShader", "programs/advect");
-    applyImpulseProgram = loadShaders("programs/vertexShader", "programs/applyImpulse");
-    applyBuoyancyProgram = loadShaders("programs/vertexShader", "programs/applyBuoyancy");
-    computeCurlProgram = loadShaders("programs/vertexShader", "programs/computeCurl");
-    applyVorticityConfinementProgram = loadShaders("programs/vertexShader", "programs/applyVorticityConfinement");
-    computeDivergenceProgram = loadShaders("programs/vertexShader", "programs/computeDivergence");
-    jacobiProgram = loadShaders("programs/vertexShader", "programs/jacobi");
-    applyPressureProgram = loadShaders("programs/vertexShader", "programs/applyPressure");
+
+    // Programs are compiled for the current boundary mode
+    advectProgram = loadProgram("programs/vertexShader", "programs/advect");
+    advectFieldsProgram = loadProgram("programs/vertexShader", "programs/advectFields");
+    applyImpulseProgram = loadProgram("programs/vertexShader", "programs/applyImpulse");
+    applyBuoyancyProgram = loadProgram("programs/vertexShader", "programs/applyBuoyancy");
+    computeCurlProgram = loadProgram("programs/vertexShader", "programs/computeCurl");
+    applyVorticityConfinementProgram = loadProgram("programs/vertexShader", "programs/applyVorticityConfinement");
+    computeDivergenceProgram = loadProgram("programs/vertexShader", "programs/computeDivergence");
+    jacobiProgram = loadProgram("programs/vertexShader", "programs/jacobi");
+    applyPressureProgram = loadProgram("programs/vertexShader", "programs/applyPressure");
+    computeTileLevelsProgram = loadProgram("programs/vertexShader", "programs/computeTileLevels");
+    tileAdvectProgram = loadProgram("programs/tileVertexShader", "programs/advect");
+    tileUpsampleProgram = loadProgram("programs/tileVertexShader", "programs/upsample");
+    reduceMaxProgram = loadProgram("programs/vertexShader", "programs/reduceMax");
+    computeResidualProgram = loadProgram("programs/vertexShader", "programs/computeResidual");
+    restrictResidualProgram = loadProgram("programs/vertexShader", "programs/restrictResidual");
+    prolongProgram = loadProgram("programs/vertexShader", "programs/upsample");
+    packProgram = loadProgram("programs/vertexShader", "programs/pack");
+    unpackProgram = loadProgram("programs/vertexShader", "programs/unpack");
+    redBlackProgram = loadProgram("programs/vertexShader", "programs/redBlack");
+    transposeProgram = loadProgram("programs/vertexShader", "programs/transpose");
+}
+
+std::string SmokeSimulation::boundaryDefines() {
+    return wrapBorders ? "#define WRAP_BORDERS" : "";
+}
+
+GLuint SmokeSimulation::loadProgram(std::string vertexShader, std::string fragmentShader) {
+    std::string defines = boundaryDefines();
+    std::string key = vertexShader + "|" + fragmentShader + "|" + defines;
+
+    // Each permutation is compiled once, switching back to it later is free
+    if (programVariants.count(key) == 0) {
+        GLuint program = loadShaders(vertexShader, fragmentShader, defines);
+        cacheUniformLocations(program);
+        programVariants[key] = program;
+    }
+
+    return programVariants[key];
+}
+
+void SmokeSimulation::updateBoundaryMode() {
+    initPrograms();
+    if (computeAvailable) initKernels();
+}
+
+void SmokeSimulation::cacheUniformLocations(GLuint program) {
+    UniformLocations &locations = uniformLocations[program];
+
+    #define LOCATE(name) locations.name = glGetUniformLocation(program, #name)
+    LOCATE(velocityTexture);
+    LOCATE(sourceTexture);
+    LOCATE(forwardTexture);
+    LOCATE(backwardTexture);
+    LOCATE(densityTexture);
+    LOCATE(temperatureTexture);
+    LOCATE(rgbTexture);
+    LOCATE(curlTexture);
+    LOCATE(divergenceTexture);
+    LOCATE(pressureTexture);
+    LOCATE(residualTexture);
+    LOCATE(packedTexture);
+    LOCATE(tileLevelTexture);
+    LOCATE(textureA);
+    LOCATE(textureB);
+    LOCATE(spectrumTexture);
+    LOCATE(bandTexture);
+    LOCATE(bandHistoryTexture);
+    LOCATE(bandHistoryRow);
+    LOCATE(gridSize);
+    LOCATE(inverseSize);
+    LOCATE(gridSpacing);
+    LOCATE(dissipation);
+    LOCATE(traceSubsteps);
+    LOCATE(macCormack);
+    LOCATE(backward);
+    LOCATE(advectRgb);
+    LOCATE(turbulence);
+    LOCATE(quantization);
+    LOCATE(position);
+    LOCATE(radius);
+    LOCATE(fill);
+    LOCATE(outwardImpulse);
+    LOCATE(gradientScale);
+    LOCATE(buoyancy);
+    LOCATE(fallForce);
+    LOCATE(riseForce);
+    LOCATE(atmosphereTemperature);
+    LOCATE(gravity);
+    LOCATE(vorticityConfinement);
+    LOCATE(vorticityConfinementForce);
+    LOCATE(refinementThreshold);
+    LOCATE(rotationScale);
+    LOCATE(tileSize);
+    LOCATE(velocityScale);
+    LOCATE(numTiles);
+    LOCATE(level);
+    LOCATE(padding);
+    LOCATE(magnitude);
+    LOCATE(sourceSize);
+    LOCATE(stride);
+    LOCATE(weight);
+    LOCATE(parity);
+    LOCATE(scale);
+    LOCATE(iterations);
+    LOCATE(screenWidth);
+    LOCATE(screenHeight);
+    LOCATE(MVP);
+    LOCATE(glyphSize);
+    #undef LOCATE
+
+    GLuint frameBlockIndex = glGetUniformBlockIndex(program, "FrameUniforms");
+    if (frameBlockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, frameBlockIndex, FRAME_UNIFORMS_BINDING);
+    }
+}
+
+SmokeSimulation::UniformLocations &SmokeSimulation::locationsFor(GLuint program) {
+    std::map<GLuint, UniformLocations>::iterator it = uniformLocations.find(program);
+
+    // Programs are cached when loaded, this only catches ones handed over later
+    if (it == uniformLocations.end()) {
+        cacheUniformLocations(program);
+        return uniformLocations[program];
+    }
+
+    return it->second;
+}
+
+void SmokeSimulation::updateFrameUniforms(float stepFraction) {
+    FrameUniforms frame;
+    frame.velocityGridSize = velocityGridSize;
+    frame.velocityInverseSize = 1.0f / velocityGridSize;
+    frame.velocityGridSpacing = velocityGridSpacing;
+    frame.timeStep = timeStep * stepFraction;
+    frame.turbulenceFrequency = 1.0f / (turbulenceScale * gridSpacing);
+    frame.turbulenceTime = turbulenceTime;
+    frame.frameNumber = frameNumber;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameUniformBuffer);
 }
 
 void SmokeSimulation::initSlabs() {
-    velocitySlab = createSlab(GRID_SIZE, GRID_SIZE, 2);
-    densitySlab = createSlab(GRID_SIZE, GRID_SIZE, 1);
-    temperatureSlab = createSlab(GRID_SIZE, GRID_SIZE, 1);
-    curlSlab = createSlab(GRID_SIZE, GRID_SIZE, 1);
-    divergenceSlab = createSlab(GRID_SIZE, GRID_SIZE, 1);
-    pressureSlab = createSlab(GRID_SIZE, GRID_SIZE, 1);
-    rgbSlab = createSlab(GRID_SIZE, GRID_SIZE, 3);
-
-    slabs.push_back(velocitySlab);
-    slabs.push_back(densitySlab);
-    slabs.push_back(temperatureSlab);
-    slabs.push_back(curlSlab);
-    slabs.push_back(divergenceSlab);
-    slabs.push_back(pressureSlab);
-    slabs.push_back(rgbSlab);
+    velocitySlab = createSlab(velocityGridSize, velocityGridSize, 2, precisions.velocity);
+    densitySlab = createSlab(GRID_SIZE, GRID_SIZE, 1, precisions.density);
+    temperatureSlab = createSlab(GRID_SIZE, GRID_SIZE, 1, precisions.temperature);
+    pressureSlab = createSlab(velocityGridSize, velocityGridSize, 1, precisions.pressure);
+    rgbAllocated = false;
+
+    slabs.push_back(&velocitySlab);
+    slabs.push_back(&densitySlab);
+    slabs.push_back(&temperatureSlab);
+    slabs.push_back(&pressureSlab);
+
+    // Curl and divergence are assigned from the transient pool once a frame graph needs them
+    curlSurface = Surface();
+    divergenceSurface = Surface();
+
+    tileLevelSurface = createSurface(NUM_TILES, NUM_TILES, 1);
+    displaySurface = createSurface(GRID_SIZE, GRID_SIZE, 4);
+    densityLevels = createLevels(1);
+    temperatureLevels = createLevels(1);
+
+    macCormackVelocitySlab = createSlab(velocityGridSize, velocityGridSize, 2);
+    macCormackScalarSlab = createSlab(GRID_SIZE, GRID_SIZE, 1);
+
+    packedDivergenceSurface = createSurface(velocityGridSize / 2, velocityGridSize / 2, 4);
+    packedPressureSlab = createSlab(velocityGridSize / 2, velocityGridSize / 2, 4, FLOAT32);
+
+    createReductionSurfaces();
+    createMultigridLevels();
+    createFieldTransfers();
+
+    glGenFramebuffers(1, &fieldsFramebuffer);
+
+    // Max speed is read back a frame late through this buffer to avoid stalling
+    float maxSpeed = 0.0f;
+    glGenBuffers(1, &maxSpeedBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, maxSpeedBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), &maxSpeed, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
     resetSlabs();
 }
 
-SmokeSimulation::Slab SmokeSimulation::createSlab(int width, int height, int numComponents) {
+void SmokeSimulation::resizeVelocitySlabs() {
+    deleteSlab(velocitySlab);
+    deleteSlab(pressureSlab);
+
+    velocitySlab = createSlab(velocityGridSize, velocityGridSize, 2, precisions.velocity);
+    pressureSlab = createSlab(velocityGridSize, velocityGridSize, 1, precisions.pressure);
+
+    deleteSlab(macCormackVelocitySlab);
+    macCormackVelocitySlab = createSlab(velocityGridSize, velocityGridSize, 2);
+
+    deleteSurface(packedDivergenceSurface);
+    deleteSlab(packedPressureSlab);
+    packedDivergenceSurface = createSurface(velocityGridSize / 2, velocityGridSize / 2, 4);
+    packedPressureSlab = createSlab(velocityGridSize / 2, velocityGridSize / 2, 4, FLOAT32);
+
+    for (Surface s : reductionSurfaces) deleteSurface(s);
+    createReductionSurfaces();
+
+    deleteMultigridLevels();
+    createMultigridLevels();
+
+    deleteFieldTransfer(velocityTransfer);
+    velocityTransfer = createFieldTransfer(&velocity[0][0].x, velocityGridSize, velocityGridSize, 2);
+}
+
+SmokeSimulation::Slab SmokeSimulation::createSlab(int width, int height, int numComponents, Precision precision) {
     Slab slab;
-    slab.pong = createSurface(width, height, numComponents);
-    slab.ping = createSurface(width, height, numComponents);
+    slab.pong = createSurface(width, height, numComponents, precision);
+    slab.ping = createSurface(width, height, numComponents, precision);
     return slab;
 }
 
-SmokeSimulation::Surface SmokeSimulation::createSurface(int width, int height, int numComponents) {
+SmokeSimulation::Surface SmokeSimulation::createSurface(int width, int height, int numComponents, Precision precision) {
     GLuint fboHandle;
     glGenFramebuffers(1, &fboHandle);
     glBindFramebuffer(GL_FRAMEBUFFER, fboHandle);
@@ -78,37 +267,229 @@ SmokeSimulation::Surface SmokeSimulation::createSurface(int width, int height, i
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    switch (numComponents) {
-        case 1: glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_HALF_FLOAT, 0); break;
-        case 2: glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_HALF_FLOAT, 0); break;
-        case 3: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_HALF_FLOAT, 0); break;
-        case 4: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, 0); break;
-        default: fprintf(stderr, "Invalid slab format."); exit(1);
-    }
+    GLenum format = formatFor(numComponents);
+
+    // Widen the format until the driver can render to it
+    GLenum internalFormat = internalFormatFor(numComponents, precision);
+    while (true) {
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureHandle, 0);
 
-    GLuint colorBuffer;
-    glGenRenderbuffers(1, &colorBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureHandle, 0);
+        if (isRenderable(internalFormat) && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) break;
+
+        if (precision == FLOAT32) {
+            fprintf(stderr, "Failed to setup FBO.");
+            exit(1);
+        }
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        fprintf(stderr, "Failed to setup FBO.");
-        exit(1);
+        precision = precision == FLOAT16 ? FLOAT32 : FLOAT16;
+        internalFormat = internalFormatFor(numComponents, precision);
+        std::cout << "Slab format is not renderable, falling back to a wider format" << std::endl;
     }
 
-    Surface surface = { fboHandle, textureHandle, numComponents };
+    Surface surface = { fboHandle, textureHandle, numComponents, width, height, internalFormat };
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+    glState.invalidate();
 
     return surface;
 }
 
-void SmokeSimulation::updateSampler() {
-    glBindSampler(0, wrapBorders ? wrapBordersSampler : boundedSampler);
-    glBindSampler(1, wrapBorders ? wrapBordersSampler : boundedSampler);
-    glBindSampler(2, wrapBorders ? wrapBordersSampler : boundedSampler);
+GLenum SmokeSimulation::formatFor(int numComponents) {
+    switch (numComponents) {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        case 4: return GL_RGBA;
+        default: fprintf(stderr, "Invalid slab format."); exit(1);
+    }
+}
+
+GLenum SmokeSimulation::internalFormatFor(int numComponents, Precision precision) {
+    GLenum floats[] = { GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F };
+    GLenum halfFloats[] = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+    GLenum unorms[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+
+    switch (precision) {
+        case FLOAT32: return floats[numComponents - 1];
+        case FLOAT11: return numComponents == 3 ? GL_R11F_G11F_B10F : halfFloats[numComponents - 1];
+        case UNORM8: return unorms[numComponents - 1];
+        default: return halfFloats[numComponents - 1];
+    }
+}
+
+bool SmokeSimulation::isRenderable(GLenum internalFormat) {
+
+    // Float render targets are optional for some formats, ask the driver when it can tell us
+    if (GLEW_ARB_internalformat_query2) {
+        GLint support = GL_NONE;
+        glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_FRAMEBUFFER_RENDERABLE, 1, &support);
+        return support == GL_FULL_SUPPORT;
+    }
+
+    // Otherwise rely on the framebuffer completeness check
+    return true;
+}
+
+float SmokeSimulation::quantizationStep(Surface s) {
+    bool unorm = s.internalFormat == GL_R8 || s.internalFormat == GL_RG8 ||
+                 s.internalFormat == GL_RGB8 || s.internalFormat == GL_RGBA8;
+    return unorm ? 1.0f / 255.0f : 0.0f;
+}
+
+void SmokeSimulation::updateSlabPrecisions() {
+    if (precisions.velocity != prevPrecisions.velocity) changeSlabPrecision(velocitySlab, precisions.velocity);
+    if (precisions.density != prevPrecisions.density) changeSlabPrecision(densitySlab, precisions.density);
+    if (precisions.temperature != prevPrecisions.temperature) changeSlabPrecision(temperatureSlab, precisions.temperature);
+    if (precisions.pressure != prevPrecisions.pressure) changeSlabPrecision(pressureSlab, precisions.pressure);
+    if (precisions.rgb != prevPrecisions.rgb && rgbAllocated) changeSlabPrecision(rgbSlab, precisions.rgb);
+
+    // Transient surfaces pick up their precision when the next frame graph allocates them
+
+    prevPrecisions = precisions;
+}
+
+void SmokeSimulation::changeSlabPrecision(Slab &slab, Precision precision) {
+    Slab replacement = createSlab(slab.ping.width, slab.ping.height, slab.ping.numComponents, precision);
+
+    // Carry the current field over so the simulation continues
+    copySurface(slab.ping, replacement.ping);
+
+    deleteSlab(slab);
+    slab = replacement;
+}
+
+SmokeSimulation::Levels SmokeSimulation::createLevels(int numComponents) {
+    Levels levels;
+    levels.half = createSurface(GRID_SIZE / HALF, GRID_SIZE / HALF, numComponents);
+    levels.quarter = createSurface(GRID_SIZE / QUARTER, GRID_SIZE / QUARTER, numComponents);
+    return levels;
+}
+
+void SmokeSimulation::createReductionSurfaces() {
+    reductionSurfaces.clear();
+
+    int size = velocityGridSize;
+    do {
+        size = std::max(size / 2, 1);
+        reductionSurfaces.push_back(createSurface(size, size, 1));
+    } while (size > 1);
+}
+
+void SmokeSimulation::createMultigridLevels() {
+    multigridLevels.clear();
+
+    // Level zero only needs a residual, its right hand side and solution are the divergence and pressure
+    MultigridLevel finest;
+    finest.residual = createSurface(velocityGridSize, velocityGridSize, 1, FLOAT32);
+    multigridLevels.push_back(finest);
+
+    // Residuals are small differences of large values, so the hierarchy is kept at full precision
+    for (int size = velocityGridSize / 2; size >= MULTIGRID_COARSEST_SIZE; size /= 2) {
+        MultigridLevel level;
+        level.rhs = createSurface(size, size, 1, FLOAT32);
+        level.correction = createSlab(size, size, 1, FLOAT32);
+        level.residual = createSurface(size, size, 1, FLOAT32);
+        multigridLevels.push_back(level);
+    }
+}
+
+void SmokeSimulation::deleteMultigridLevels() {
+    for (size_t l = 0; l < multigridLevels.size(); l++) {
+        if (l > 0) {
+            deleteSurface(multigridLevels[l].rhs);
+            deleteSlab(multigridLevels[l].correction);
+        }
+        deleteSurface(multigridLevels[l].residual);
+    }
+
+    multigridLevels.clear();
+}
+
+void SmokeSimulation::deleteSlab(Slab slab) {
+    deleteSurface(slab.ping);
+    deleteSurface(slab.pong);
+}
+
+void SmokeSimulation::allocateRgbSlab() {
+    if (rgbAllocated) return;
+
+    rgbSlab = createSlab(GRID_SIZE, GRID_SIZE, 3, precisions.rgb);
+    rgbLevels = createLevels(3);
+    macCormackRgbSlab = createSlab(GRID_SIZE, GRID_SIZE, 3);
+    rgbAllocated = true;
+}
+
+void SmokeSimulation::releaseRgbSlab() {
+    if (!rgbAllocated) return;
+
+    deleteSlab(rgbSlab);
+    deleteSurface(rgbLevels.half);
+    deleteSurface(rgbLevels.quarter);
+    deleteSlab(macCormackRgbSlab);
+    rgbSlab = Slab();
+    rgbAllocated = false;
+}
+
+int SmokeSimulation::transientFormat(int size, int numComponents, Precision precision) {
+
+    // Everything a transient surface is created from, only surfaces of the same format share memory
+    return (size * 4 + numComponents - 1) * 4 + precision;
+}
+
+void SmokeSimulation::allocateTransientSurfaces() {
+    int numSlots = frameGraph.numSlots();
+
+    // Release the slots the current graph no longer needs
+    while ((int) transientSurfaces.size() > numSlots) {
+        deleteSurface(transientSurfaces.back());
+        transientSurfaces.pop_back();
+        transientFormats.pop_back();
+    }
+
+    for (int slot = 0; slot < numSlots; slot++) {
+        int format = frameGraph.slotFormat(slot);
+        bool allocated = slot < (int) transientSurfaces.size();
+        if (allocated && transientFormats[slot] == format) continue;
+
+        int size = format / 16;
+        Surface surface = createSurface(size, size, format / 4 % 4 + 1, Precision(format % 4));
+
+        if (allocated) {
+            deleteSurface(transientSurfaces[slot]);
+            transientSurfaces[slot] = surface;
+            transientFormats[slot] = format;
+        } else {
+            transientSurfaces.push_back(surface);
+            transientFormats.push_back(format);
+        }
+    }
+}
+
+SmokeSimulation::Surface SmokeSimulation::transientSurface(FrameGraph::Resource resource) {
+    int slot = frameGraph.slotFor(resource);
+    return slot < 0 ? Surface() : transientSurfaces[slot];
+}
+
+void SmokeSimulation::deleteSurface(Surface s) {
+    glDeleteFramebuffers(1, &s.fboHandle);
+    glDeleteTextures(1, &s.textureHandle);
+
+    // The names may be handed out again, so cached bindings can no longer be trusted
+    glState.invalidate();
+}
+
+void SmokeSimulation::bindSamplers() {
+    for (int unit = 0; unit < SAMPLER_UNITS; unit++) {
+        glState.bindSampler(unit, wrapBorders ? wrapBordersSampler : boundedSampler);
+    }
+}
+
+void SmokeSimulation::bindSurface(Surface s) {
+    glState.bindFramebuffer(s.fboHandle);
+    glState.viewport(s.width, s.height);
 }
 
 void SmokeSimulation::swapSurfaces(Slab &slab) {
@@ -118,342 +499,812 @@ void SmokeSimulation::swapSurfaces(Slab &slab) {
 }
 
 void SmokeSimulation::clearSurface(Surface s, float v) {
-    glBindFramebuffer(GL_FRAMEBUFFER, s.fboHandle);
+    glState.bindFramebuffer(s.fboHandle);
     glClearColor(v, v, v, v);
     glClear(GL_COLOR_BUFFER_BIT);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SmokeSimulation::copySurface(Surface source, Surface destination) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source.fboHandle);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination.fboHandle);
+    glBlitFramebuffer(0, 0, source.width, source.height, 0, 0, destination.width, destination.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+    glState.invalidate();
 }
 
 void SmokeSimulation::resetSlabs() {
-    for (Slab slab : slabs) {
-        clearSurface(slab.ping, 0.0f);
-        clearSurface(slab.pong, 0.0f);
+    for (Slab* slab : slabs) {
+        clearSurface(slab->ping, 0.0f);
+        clearSurface(slab->pong, 0.0f);
     }
+
+    // Recreated cleared when a composition next uses it
+    releaseRgbSlab();
 }
 
 void SmokeSimulation::resetState() {
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (int unit = AUDIO_TEXTURE_UNIT + NUM_AUDIO_TEXTURES - 1; unit >= AUDIO_TEXTURE_UNIT; unit--) {
+        glState.bindTexture(unit, 0);
+    }
+    for (int unit = SAMPLER_UNITS - 1; unit >= 0; unit--) {
+        glState.bindTexture(unit, 0);
+        glState.bindSampler(unit, 0);
+    }
+    glState.bindFramebuffer(defaultFramebuffer);
+    glState.disableBlend();
+    glState.bindVertexArray(defaultVertexArray);
+}
+
+void SmokeSimulation::drawTiles(GLuint program, Resolution level, float padding) {
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.tileLevelTexture, 2);
+    glUniform1i(locations.numTiles, NUM_TILES);
+    glUniform1i(locations.level, level);
+    glUniform1f(locations.padding, padding);
+
+    glState.bindTexture(2, tileLevelSurface.textureHandle);
+
+    // Tiles are generated in the vertex shader, no attributes are read
+    glState.disableBlend();
+    glState.bindVertexArray(tileVertexArray);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, NUM_TILES * NUM_TILES);
+}
+
+bool SmokeSimulation::advectsRgb() {
+    return std::find(compositionFields.begin(), compositionFields.end(), RGB) != compositionFields.end();
+}
+
+SmokeSimulation::FrameResources SmokeSimulation::declareFrameResources() {
+    frameGraph.clear();
+
+    FrameResources r;
+    r.velocity = frameGraph.addResource("velocity");
+    r.density = frameGraph.addResource("density");
+    r.temperature = frameGraph.addResource("temperature");
+    r.rgb = frameGraph.addResource("rgb");
+    r.pressure = frameGraph.addResource("pressure");
+    r.traceSubsteps = frameGraph.addResource("traceSubsteps");
+    r.tileLevels = frameGraph.addResource("tileLevels");
+
+    // Curl and divergence only live within an update, so they may share memory
+    r.curl = frameGraph.addResource("curl", transientFormat(velocityGridSize, 1, precisions.curl));
+    r.divergence = frameGraph.addResource("divergence", transientFormat(velocityGridSize, 1, precisions.divergence));
+
+    // The simulation state carries over to the next update, the rest only when it is displayed
+    frameGraph.addOutput(r.velocity);
+    frameGraph.addOutput(r.density);
+    frameGraph.addOutput(r.temperature);
+    if (advectsRgb()) frameGraph.addOutput(r.rgb);
+
+    bool displayCurl = currentDisplay == CURL ||
+                       (currentDisplay == COMPOSITION && std::find(compositionFields.begin(), compositionFields.end(), CURL) != compositionFields.end());
+    if (displayCurl || computeIntermediateFields) frameGraph.addOutput(r.curl);
+    if (computeIntermediateFields) frameGraph.addOutput(r.divergence);
+
+    return r;
+}
+
+void SmokeSimulation::executeFrameGraph(FrameResources resources) {
+    frameGraph.compile();
+    allocateTransientSurfaces();
+
+    curlSurface = transientSurface(resources.curl);
+    divergenceSurface = transientSurface(resources.divergence);
+
+    frameGraph.execute();
+
+    // Transients that are not outputs may have been overwritten by a later pass sharing their memory
+    if (!frameGraph.isOutput(resources.curl)) curlSurface = Surface();
+    if (!frameGraph.isOutput(resources.divergence)) divergenceSurface = Surface();
 }
 
 void SmokeSimulation::updateGPU() {
 
-    // Update texture parameters if needed
+    // Switch to the program permutations for the boundary mode if needed
     if (prevWrapBorders != wrapBorders) {
-        updateSampler();
+        updateBoundaryMode();
     }
     prevWrapBorders = wrapBorders;
 
-    // Advect velocity through velocity
-    advect(velocitySlab.ping, velocitySlab.ping, velocitySlab.pong, velocityDissipation);
-    swapSurfaces(velocitySlab);
-    resetState();
+    bindSamplers();
 
-    // Smoke emitter
-    if (enableEmitter) {
-        glm::vec2 position = glm::vec2(GRID_SIZE / 2 * SCREEN_WIDTH / GRID_SIZE, GRID_SIZE * SCREEN_HEIGHT / GRID_SIZE - 2);
-        glm::vec2 force = glm::vec2(myRandom() * pulseForce - pulseForce / 2.0f, -pulseForce);
+    updateFrameUniforms();
 
-        emitGPU(position, emitterRange,
-                std::vector<Display>{ VELOCITY, DENSITY, TEMPERATURE },
-                std::vector<glm::vec3>{ glm::vec3(force, 0.0f), glm::vec3(0.2f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) }
-        );
+    bool advectRgb = advectsRgb();
+    if (advectRgb) {
+        allocateRgbSlab();
+    } else {
+        releaseRgbSlab();
     }
 
-    // Buoyancy
-    if (enableBuoyancy) {
-        applyBuoyancy(temperatureSlab.ping, densitySlab.ping, velocitySlab.ping);
-        resetState();
+    bool stepVelocity = updatesVelocity();
+
+    FrameResources r = declareFrameResources();
+
+    // Advect velocity through velocity
+    if (stepVelocity) {
+        frameGraph.addPass("advectVelocity", { r.velocity, r.traceSubsteps }, { r.velocity, r.traceSubsteps }, [this]() {
+            float dissipation = beginVelocityStep();
+            if (enableMacCormack) {
+                advectMacCormack(velocitySlab.ping, velocitySlab.ping, velocitySlab.pong, macCormackVelocitySlab, dissipation);
+            } else {
+                advect(velocitySlab.ping, velocitySlab.ping, velocitySlab.pong, dissipation);
+            }
+            swapSurfaces(velocitySlab);
+        });
     }
 
-    // Compute curl
-    if (enableVorticityConfinement || computeIntermediateFields) {
-        computeCurl(velocitySlab.ping, curlSlab.pong);
-        swapSurfaces(curlSlab);
-        resetState();
+    // Smoke emitter
+    addEmitterPass(r);
+
+    // Buoyancy
+    if (enableBuoyancy && stepVelocity) {
+        frameGraph.addPass("applyBuoyancy", { r.temperature, r.density, r.velocity }, { r.velocity }, [this]() {
+            applyBuoyancy(temperatureSlab.ping, densitySlab.ping, velocitySlab.ping);
+        });
     }
 
+    // Compute curl, culled unless vorticity confinement or the display reads it
+    frameGraph.addPass("computeCurl", { r.velocity }, { r.curl }, [this]() {
+        computeCurl(velocitySlab.ping, curlSurface);
+    });
+
     // Apply vorticity confinement
-    if (enableVorticityConfinement) {
-        applyVorticityConfinement(curlSlab.ping, velocitySlab.ping);
-        resetState();
+    if (enableVorticityConfinement && stepVelocity) {
+        frameGraph.addPass("applyVorticityConfinement", { r.curl, r.velocity }, { r.velocity }, [this]() {
+            applyVorticityConfinement(curlSurface, velocitySlab.ping);
+        });
     }
 
-    // Compute divergence
-    if (enablePressureSolver || computeIntermediateFields) {
-        computeDivergence(velocitySlab.ping, divergenceSlab.pong);
-        swapSurfaces(divergenceSlab);
-        resetState();
-    }
+    // Compute divergence, culled unless the pressure solver reads it
+    frameGraph.addPass("computeDivergence", { r.velocity }, { r.divergence }, [this]() {
+        computeDivergence(velocitySlab.ping, divergenceSurface);
+    });
 
     // Pressure solver
-    if (enablePressureSolver) {
+    if (enablePressureSolver && stepVelocity) {
+        frameGraph.addPass("solvePressure", { r.divergence }, { r.pressure }, [this]() {
 
-        // Reset the pressure field
-        clearSurface(pressureSlab.ping, 0.0f);
-        clearSurface(pressureSlab.pong, 0.0f);
+            // Reset the pressure field
+            clearSurface(pressureSlab.ping, 0.0f);
+            clearSurface(pressureSlab.pong, 0.0f);
 
-        // Iteratively solve the new pressure field
-        for (int iteration = 0; iteration < jacobiIterations; iteration++) {
-            jacobi(divergenceSlab.ping, pressureSlab.ping, pressureSlab.pong);
-            swapSurfaces(pressureSlab);
-        }
+            // Iteratively solve the new pressure field
+            solvePressure();
+        });
 
-        resetState();
-
-        // Apply pressure
-        applyPressure(pressureSlab.ping, velocitySlab.ping);
-        resetState();
+        frameGraph.addPass("applyPressure", { r.pressure, r.velocity }, { r.velocity }, [this]() {
+            applyPressure(pressureSlab.ping, velocitySlab.ping);
+        });
     }
 
-    // Advect density and temperature through velocity
-    advect(velocitySlab.ping, densitySlab.ping, densitySlab.pong, densityDissipation);
-    swapSurfaces(densitySlab);
-    resetState();
+    // Substep the back trace so the fastest particle stays within the CFL target
+    frameGraph.addPass("updateTraceSubsteps", { r.velocity }, { r.traceSubsteps }, [this, stepVelocity]() {
+        updateTraceSubsteps(enableAdaptiveSubstepping ? reduceMaxSpeed(velocitySlab.ping) : 0.0f);
+        if (stepVelocity) endVelocityStep();
+    });
+
+    // Classify tiles by how much detail they hold
+    if (enableAdaptiveResolution) {
+        frameGraph.addPass("computeTileLevels", { r.density, r.velocity }, { r.tileLevels }, [this]() {
+            computeTileLevels(densitySlab.ping, velocitySlab.ping, tileLevelSurface);
+        });
+    }
 
-    advect(velocitySlab.ping, temperatureSlab.ping, temperatureSlab.pong, temperatureDissipation);
-    swapSurfaces(temperatureSlab);
-    resetState();
+    // Advect density, temperature and rgb if enabled through velocity in a single pass
+    if (!enableAdaptiveResolution && !enableMacCormack) {
+        frameGraph.addPass("advectFields", { r.velocity, r.traceSubsteps, r.density, r.temperature, r.rgb },
+                           { r.density, r.temperature, r.rgb }, [this, advectRgb]() {
+            advectFields(velocitySlab.ping, advectRgb);
+            swapSurfaces(densitySlab);
+            swapSurfaces(temperatureSlab);
+            if (advectRgb) swapSurfaces(rgbSlab);
+        });
+    } else {
 
-    // Advect rgb through velocity if enabled
-    if (std::find(compositionFields.begin(), compositionFields.end(), RGB) != compositionFields.end()) {
-        advect(velocitySlab.ping, rgbSlab.ping, rgbSlab.pong, rgbDissipation);
-        swapSurfaces(rgbSlab);
-        resetState();
+        // Advect density and temperature through velocity
+        frameGraph.addPass("advectDensity", { r.velocity, r.traceSubsteps, r.tileLevels, r.density }, { r.density }, [this]() {
+            advectField(velocitySlab.ping, densitySlab, densityLevels, macCormackScalarSlab, densityDissipation);
+            swapSurfaces(densitySlab);
+        });
+
+        frameGraph.addPass("advectTemperature", { r.velocity, r.traceSubsteps, r.tileLevels, r.temperature }, { r.temperature }, [this]() {
+            advectField(velocitySlab.ping, temperatureSlab, temperatureLevels, macCormackScalarSlab, temperatureDissipation);
+            swapSurfaces(temperatureSlab);
+        });
+
+        // Advect rgb through velocity, culled unless a composition shows it
+        frameGraph.addPass("advectRgb", { r.velocity, r.traceSubsteps, r.tileLevels, r.rgb }, { r.rgb }, [this]() {
+            advectField(velocitySlab.ping, rgbSlab, rgbLevels, macCormackRgbSlab, rgbDissipation);
+            swapSurfaces(rgbSlab);
+        });
     }
+
+    executeFrameGraph(r);
+}
+
+float SmokeSimulation::beginVelocityStep() {
+    float stepScale = velocityStepScale();
+
+    // The velocity and the forces on it step over the whole interval, with the trace substepped to suit
+    updateTraceSubsteps(lastMaxSpeed, stepScale);
+    updateFrameUniforms(stepScale);
+
+    return powf(velocityDissipation, stepScale);
+}
+
+void SmokeSimulation::endVelocityStep() {
+
+    // Back to a single frame's step for the visual fields
+    updateFrameUniforms();
+}
+
+void SmokeSimulation::addEmitterPass(FrameResources r) {
+    if (!enableEmitter) return;
+
+    frameGraph.addPass("emitter", { r.velocity, r.density, r.temperature }, { r.velocity, r.density, r.temperature }, [this]() {
+        applyEmitter();
+    });
 }
 
 void SmokeSimulation::emitGPU(glm::vec2 position, float range, std::vector<Display> fields, std::vector<glm::vec3> values) {
     position *= windowToGrid;
 
     for (int i = 0; i < fields.size(); i++) {
-        applyImpulse(dataForDisplayGPU(fields[i]).ping, position, range, values[i], false);
-    }
+        glm::vec3 value = values[i];
 
-    resetState();
+        // Velocity impulses wait for the next velocity update and carry the whole interval's push
+        if (fields[i] == VELOCITY) {
+            if (!updatesVelocity()) continue;
+            value *= velocityStepScale();
+        }
+
+        applyImpulse(dataForDisplayGPU(fields[i]).ping, position, range, value, false);
+    }
 }
 
 void SmokeSimulation::advect(Surface velocitySurface, Surface source, Surface destination, float dissipation) {
+    prepareAdvect(advectProgram, velocitySurface, source, destination, dissipation);
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::advectTiles(Surface velocitySurface, Surface source, Surface destination, float dissipation, Resolution level) {
+    prepareAdvect(tileAdvectProgram, velocitySurface, source, destination, dissipation);
+
+    // Coarse tiles are padded by a texel so upsampling never reads outside them
+    drawTiles(tileAdvectProgram, level, level == FULL ? 0.0f : 2.0f / destination.width);
+}
+
+void SmokeSimulation::advectField(Surface velocitySurface, Slab slab, Levels levels, Slab scratch, float dissipation) {
+    if (!enableAdaptiveResolution) {
+        if (enableMacCormack) {
+            advectMacCormack(velocitySurface, slab.ping, slab.pong, scratch, dissipation);
+        } else {
+            advect(velocitySurface, slab.ping, slab.pong, dissipation);
+        }
+        return;
+    }
+
+    advectTiles(velocitySurface, slab.ping, levels.half, dissipation, HALF);
+    advectTiles(velocitySurface, slab.ping, levels.quarter, dissipation, QUARTER);
+    advectTiles(velocitySurface, slab.ping, slab.pong, dissipation, FULL);
+
+    upsampleTiles(levels.half, slab.pong, HALF);
+    upsampleTiles(levels.quarter, slab.pong, QUARTER);
+}
+
+void SmokeSimulation::advectMacCormack(Surface velocitySurface, Surface source, Surface destination, Slab scratch, float dissipation) {
     GLuint program = advectProgram;
-    glUseProgram(program);
-
-    GLint gridSizeLocation = glGetUniformLocation(program, "gridSize");
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint wrapBordersLocation = glGetUniformLocation(program, "wrapBorders");
-    GLint gridSpacingLocation = glGetUniformLocation(program, "gridSpacing");
-    GLint timeStepLocation = glGetUniformLocation(program, "timeStep");
-    GLint dissipationLocation = glGetUniformLocation(program, "dissipation");
-    GLint sourceTextureLocation = glGetUniformLocation(program, "sourceTexture");
-
-    glUniform1i(gridSizeLocation, GRID_SIZE);
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(wrapBordersLocation, wrapBorders);
-    glUniform1f(gridSpacingLocation, gridSpacing);
-    glUniform1f(timeStepLocation, timeStep);
-    glUniform1f(dissipationLocation, dissipation);
-    glUniform1i(sourceTextureLocation, 1);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, destination.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, velocitySurface.textureHandle);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, source.textureHandle);
+    UniformLocations &locations = locationsFor(program);
+    bool turbulent = enableTurbulence && source.textureHandle != velocitySurface.textureHandle;
+
+    // Forward step
+    advect(velocitySurface, source, scratch.ping, dissipation);
+
+    // Backward step through the reversed flow, with the same detail as the forward step
+    prepareAdvect(program, velocitySurface, scratch.ping, scratch.pong, 1.0f);
+    glUniform1i(locations.backward, true);
+    glUniform1f(locations.turbulence, turbulent ? turbulenceStrength : 0.0f);
+    drawFullscreenQuad();
+
+    // Correct the forward step by the round trip error
+    prepareAdvect(program, velocitySurface, source, destination, dissipation);
+
+    glUniform1i(locations.macCormack, true);
+    glUniform1i(locations.forwardTexture, 2);
+    glUniform1i(locations.backwardTexture, 3);
+
+    glState.bindTexture(2, scratch.ping.textureHandle);
+    glState.bindTexture(3, scratch.pong.textureHandle);
+
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::prepareAdvect(GLuint program, Surface velocitySurface, Surface source, Surface destination, float dissipation) {
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    // Detail is only synthesised for the visual fields, never the velocity itself
+    bool turbulent = enableTurbulence && source.textureHandle != velocitySurface.textureHandle;
+
+    // The source and destination share a grid, the velocity may be coarser
+    glUniform1i(locations.gridSize, destination.width);
+    glUniform1f(locations.inverseSize, 1.0f / destination.width);
+    glUniform1f(locations.gridSpacing, gridSpacing * GRID_SIZE / destination.width);
+    glUniform1f(locations.dissipation, dissipation);
+    glUniform1i(locations.traceSubsteps, traceSubsteps);
+    glUniform1i(locations.macCormack, false);
+    glUniform1i(locations.backward, false);
+    glUniform1i(locations.sourceTexture, 1);
+    glUniform1f(locations.turbulence, turbulent ? turbulenceStrength : 0.0f);
+    glUniform1f(locations.quantization, quantizationStep(destination));
+
+    bindSurface(destination);
+    glState.bindTexture(0, velocitySurface.textureHandle);
+    glState.bindTexture(1, source.textureHandle);
+}
+
+void SmokeSimulation::advectFields(Surface velocitySurface, bool advectRgb) {
+    GLuint program = advectFieldsProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1f(locations.inverseSize, 1.0f / GRID_SIZE);
+    glUniform1f(locations.gridSpacing, gridSpacing);
+    glUniform1i(locations.traceSubsteps, traceSubsteps);
+    glUniform1i(locations.advectRgb, advectRgb);
+    glUniform3f(locations.dissipation, densityDissipation, temperatureDissipation, rgbDissipation);
+    glUniform3f(locations.quantization, quantizationStep(densitySlab.pong), quantizationStep(temperatureSlab.pong), quantizationStep(rgbSlab.pong));
+    glUniform1i(locations.densityTexture, 1);
+    glUniform1i(locations.temperatureTexture, 2);
+    glUniform1i(locations.rgbTexture, 3);
+    glUniform1f(locations.turbulence, enableTurbulence ? turbulenceStrength : 0.0f);
+
+    // The slabs ping pong independently, so their destinations are attached every frame
+    glState.bindFramebuffer(fieldsFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, densitySlab.pong.textureHandle, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, temperatureSlab.pong.textureHandle, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, advectRgb ? rgbSlab.pong.textureHandle : 0, 0);
+
+    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(advectRgb ? 3 : 2, drawBuffers);
+    glState.viewport(GRID_SIZE, GRID_SIZE);
+
+    glState.bindTexture(0, velocitySurface.textureHandle);
+    glState.bindTexture(1, densitySlab.ping.textureHandle);
+    glState.bindTexture(2, temperatureSlab.ping.textureHandle);
+    glState.bindTexture(3, rgbSlab.ping.textureHandle);
+
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::upsampleTiles(Surface source, Surface destination, Resolution level) {
+    GLuint program = tileUpsampleProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1f(locations.inverseSize, 1.0f / destination.width);
+    glUniform1i(locations.sourceTexture, 0);
+    glUniform1f(locations.quantization, quantizationStep(destination));
+
+    bindSurface(destination);
+    glState.bindTexture(0, source.textureHandle);
+
+    drawTiles(program, level, 0.0f);
+}
+
+void SmokeSimulation::computeTileLevels(Surface densitySurface, Surface velocitySurface, Surface levelSurface) {
+    GLuint program = computeTileLevelsProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.tileSize, TILE_SIZE);
+    glUniform1i(locations.gridSize, GRID_SIZE);
+    glUniform1i(locations.velocityScale, velocityResolution);
+    glUniform1f(locations.rotationScale, timeStep / velocityGridSpacing);
+    glUniform1f(locations.refinementThreshold, refinementThreshold);
+    glUniform1i(locations.densityTexture, 0);
+    glUniform1i(locations.velocityTexture, 1);
+
+    bindSurface(levelSurface);
+    glState.bindTexture(0, densitySurface.textureHandle);
+    glState.bindTexture(1, velocitySurface.textureHandle);
 
     drawFullscreenQuad();
 }
 
+float SmokeSimulation::reduceMaxSpeed(Surface velocitySurface) {
+
+    // Collect the result of the previous frame's reduction, which has finished by now
+    float maxSpeed = 0.0f;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, maxSpeedBuffer);
+    float* result = (float*) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (result) {
+        maxSpeed = *result;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    GLuint program = reduceMaxProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    // Halve the field down to a single texel, taking velocity magnitudes on the first pass
+    Surface source = velocitySurface;
+    for (Surface destination : reductionSurfaces) {
+        glUniform1i(locations.sourceSize, source.width);
+        glUniform1i(locations.magnitude, source.textureHandle == velocitySurface.textureHandle);
+
+        bindSurface(destination);
+        glState.bindTexture(0, source.textureHandle);
+
+        drawFullscreenQuad();
+        source = destination;
+    }
+
+    // Queue the readback of this frame's maximum for the next frame
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, maxSpeedBuffer);
+    glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return maxSpeed;
+}
+
 void SmokeSimulation::computeDivergence(Surface velocitySurface, Surface divergenceSurface) {
     GLuint program = computeDivergenceProgram;
-    glUseProgram(program);
+    glState.useProgram(program);
 
-    GLint gridSizeLocation = glGetUniformLocation(program, "gridSize");
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint wrapBordersLocation = glGetUniformLocation(program, "wrapBorders");
-    GLint gridSpacingLocation = glGetUniformLocation(program, "gridSpacing");
-    GLint gradientScaleLocation = glGetUniformLocation(program, "gradientScale");
+    UniformLocations &locations = locationsFor(program);
 
-    glUniform1i(gridSizeLocation, GRID_SIZE);
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(wrapBordersLocation, wrapBorders);
-    glUniform1f(gridSpacingLocation, gridSpacing);
-    glUniform1f(gradientScaleLocation, -((2 * gridSpacing * fluidDensity) / timeStep));
+    glUniform1f(locations.inverseSize, 1.0f / velocityGridSize);
+    glUniform1f(locations.gridSpacing, velocityGridSpacing);
+    glUniform1f(locations.gradientScale, -((2 * velocityGridSpacing * fluidDensity) / timeStep));
 
-    glBindFramebuffer(GL_FRAMEBUFFER, divergenceSurface.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, velocitySurface.textureHandle);
+    bindSurface(divergenceSurface);
+    glState.bindTexture(0, velocitySurface.textureHandle);
 
     drawFullscreenQuad();
 }
 
-void SmokeSimulation::jacobi(Surface divergenceSurface, Surface pressureSource, Surface pressureDestination) {
+void SmokeSimulation::jacobi(Surface divergenceSurface, Surface pressureSource, Surface pressureDestination, int stride, float weight) {
     GLuint program = jacobiProgram;
-    glUseProgram(program);
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, pressureDestination.width);
+    glUniform1i(locations.stride, stride);
+    glUniform1f(locations.weight, weight);
+    glUniform1i(locations.pressureTexture, 1);
+
+    bindSurface(pressureDestination);
+    glState.bindTexture(0, divergenceSurface.textureHandle);
+    glState.bindTexture(1, pressureSource.textureHandle);
+
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::computeResidual(Surface divergenceSurface, Surface pressureSurface, Surface residualSurface, int stride) {
+    GLuint program = computeResidualProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, residualSurface.width);
+    glUniform1i(locations.stride, stride);
+    glUniform1i(locations.pressureTexture, 1);
+
+    bindSurface(residualSurface);
+    glState.bindTexture(0, divergenceSurface.textureHandle);
+    glState.bindTexture(1, pressureSurface.textureHandle);
+
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::restrictResidual(Surface residualSurface, Surface rhsSurface, float scale) {
+    GLuint program = restrictResidualProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1f(locations.inverseSize, 1.0f / rhsSurface.width);
+    glUniform1f(locations.scale, scale);
+
+    bindSurface(rhsSurface);
+    glState.bindTexture(0, residualSurface.textureHandle);
 
-    GLint gridSizeLocation = glGetUniformLocation(program, "gridSize");
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint wrapBordersLocation = glGetUniformLocation(program, "wrapBorders");
-    GLint pressureTextureLocation = glGetUniformLocation(program, "pressureTexture");
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::prolongCorrection(Surface correctionSurface, Surface pressureDestination) {
+    GLuint program = prolongProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1f(locations.inverseSize, 1.0f / pressureDestination.width);
+    glUniform1i(locations.sourceTexture, 0);
+
+    bindSurface(pressureDestination);
+    glState.bindTexture(0, correctionSurface.textureHandle);
+
+    drawFullscreenQuad(GL_ONE, GL_ONE);
+}
+
+void SmokeSimulation::smoothMultigridLevel(int level, int iterations, float weight) {
+    Surface rhs = level == 0 ? divergenceSurface : multigridLevels[level].rhs;
+    Slab &solution = level == 0 ? pressureSlab : multigridLevels[level].correction;
+
+    // The finest level keeps the solver's stride two stencil, coarser levels are plain 5 point Laplacians
+    int stride = level == 0 ? 2 : 1;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        jacobi(rhs, solution.ping, solution.pong, stride, weight);
+        swapSurfaces(solution);
+    }
+}
+
+void SmokeSimulation::multigridCycle() {
+    int coarsest = multigridLevels.size() - 1;
+    float weight = 0.8f;
+
+    // Smooth each level and pass its residual down as the next level's right hand side
+    for (int level = 0; level < coarsest; level++) {
+        Surface rhs = level == 0 ? divergenceSurface : multigridLevels[level].rhs;
+        Slab &solution = level == 0 ? pressureSlab : multigridLevels[level].correction;
+
+        // Corrections start from zero every cycle
+        if (level > 0) clearSurface(solution.ping, 0.0f);
+
+        smoothMultigridLevel(level, smoothingIterations, weight);
+        computeResidual(rhs, solution.ping, multigridLevels[level].residual, level == 0 ? 2 : 1);
+
+        // Below the first level the grid spacing doubles, scaling the Laplacian by four
+        restrictResidual(multigridLevels[level].residual, multigridLevels[level + 1].rhs, level == 0 ? 1.0f : 4.0f);
+    }
 
-    glUniform1i(gridSizeLocation, GRID_SIZE);
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(wrapBordersLocation, wrapBorders);
-    glUniform1i(pressureTextureLocation, 1);
+    clearSurface(multigridLevels[coarsest].correction.ping, 0.0f);
+    smoothMultigridLevel(coarsest, MULTIGRID_COARSEST_ITERATIONS, 1.0f);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, pressureDestination.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, divergenceSurface.textureHandle);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, pressureSource.textureHandle);
+    // Add each correction to the finer level and smooth out the interpolation error
+    for (int level = coarsest - 1; level >= 0; level--) {
+        Slab &solution = level == 0 ? pressureSlab : multigridLevels[level].correction;
+
+        prolongCorrection(multigridLevels[level + 1].correction.ping, solution.ping);
+        smoothMultigridLevel(level, smoothingIterations, weight);
+    }
+}
+
+void SmokeSimulation::pack(Surface source, Surface destination) {
+    GLuint program = packProgram;
+    glState.useProgram(program);
+
+    bindSurface(destination);
+    glState.bindTexture(0, source.textureHandle);
+
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::unpack(Surface packedSurface, Surface destination) {
+    GLuint program = unpackProgram;
+    glState.useProgram(program);
+
+    bindSurface(destination);
+    glState.bindTexture(0, packedSurface.textureHandle);
 
     drawFullscreenQuad();
 }
 
+void SmokeSimulation::redBlack(Surface packedDivergenceSurface, Surface pressureSource, Surface pressureDestination, int parity) {
+    GLuint program = redBlackProgram;
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, pressureDestination.width);
+    glUniform1i(locations.parity, parity);
+    glUniform1i(locations.pressureTexture, 1);
+
+    bindSurface(pressureDestination);
+    glState.bindTexture(0, packedDivergenceSurface.textureHandle);
+    glState.bindTexture(1, pressureSource.textureHandle);
+
+    drawFullscreenQuad();
+}
+
+void SmokeSimulation::solvePressure() {
+    if (enableMultigrid) {
+        for (int cycle = 0; cycle < multigridCycles; cycle++) {
+            multigridCycle();
+        }
+    } else if (enablePackedSolver) {
+        pack(divergenceSurface, packedDivergenceSurface);
+        clearSurface(packedPressureSlab.ping, 0.0f);
+
+        // Red-black sweeps over a quarter of the texels, each solving four cells
+        for (int iteration = 0; iteration < jacobiIterations; iteration++) {
+            redBlack(packedDivergenceSurface, packedPressureSlab.ping, packedPressureSlab.pong, 0);
+            swapSurfaces(packedPressureSlab);
+            redBlack(packedDivergenceSurface, packedPressureSlab.ping, packedPressureSlab.pong, 1);
+            swapSurfaces(packedPressureSlab);
+        }
+
+        unpack(packedPressureSlab.ping, pressureSlab.ping);
+    } else {
+        for (int iteration = 0; iteration < jacobiIterations; iteration++) {
+            jacobi(divergenceSurface, pressureSlab.ping, pressureSlab.pong, 2, 1.0f);
+            swapSurfaces(pressureSlab);
+        }
+    }
+}
+
 void SmokeSimulation::applyPressure(Surface pressureSurface, Surface velocityDestination) {
     GLuint program = applyPressureProgram;
-    glUseProgram(program);
+    glState.useProgram(program);
 
-    GLint gridSizeLocation = glGetUniformLocation(program, "gridSize");
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint wrapBordersLocation = glGetUniformLocation(program, "wrapBorders");
-    GLint gradientScaleLocation = glGetUniformLocation(program, "gradientScale");
+    UniformLocations &locations = locationsFor(program);
 
-    glUniform1i(gridSizeLocation, GRID_SIZE);
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(wrapBordersLocation, wrapBorders);
-    glUniform1f(gradientScaleLocation, -(timeStep / (2 * fluidDensity * gridSpacing)));
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1f(locations.gradientScale, -(timeStep / (2 * fluidDensity * velocityGridSpacing)));
 
-    glBindFramebuffer(GL_FRAMEBUFFER, velocityDestination.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, pressureSurface.textureHandle);
+    bindSurface(velocityDestination);
+    glState.bindTexture(0, pressureSurface.textureHandle);
+
+    drawFullscreenQuad(GL_ONE, GL_ONE);
+}
+
+void SmokeSimulation::transposeSurface(Surface source, Surface destination) {
+    GLuint program = transposeProgram;
+    glState.useProgram(program);
+
+    bindSurface(destination);
+    glState.bindTexture(0, source.textureHandle);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE);
     drawFullscreenQuad();
-    glDisable(GL_BLEND);
 }
 
 void SmokeSimulation::applyImpulse(Surface destination, glm::vec2 position, float radius, glm::vec3 fill, bool allowOutwardImpulse) {
     GLuint program = applyImpulseProgram;
-    glUseProgram(program);
+    glState.useProgram(program);
 
-    GLint gridSpacingLocation = glGetUniformLocation(program, "gridSpacing");
-    GLint positionLocation = glGetUniformLocation(program, "position");
-    GLint radiusLocation = glGetUniformLocation(program, "radius");
-    GLint fillLocation = glGetUniformLocation(program, "fill");
-    GLint outwardImpulseLocation = glGetUniformLocation(program, "outwardImpulse");
+    UniformLocations &locations = locationsFor(program);
 
-    glUniform1f(gridSpacingLocation, gridSpacing);
-    glUniform2f(positionLocation, position.x, position.y);
-    glUniform1f(radiusLocation, radius);
-    glUniform3f(fillLocation, fill.x, fill.y, fill.z);
-    glUniform1i(outwardImpulseLocation, allowOutwardImpulse && !randomPulseAngle);
+    glUniform1f(locations.gridSpacing, gridSpacing * GRID_SIZE / destination.width);
+    glUniform2f(locations.position, position.x, position.y);
+    glUniform1f(locations.radius, radius);
+    glUniform3f(locations.fill, fill.x, fill.y, fill.z);
+    glUniform1i(locations.outwardImpulse, allowOutwardImpulse && !randomPulseAngle);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, destination.fboHandle);
+    bindSurface(destination);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    drawFullscreenQuad();
-    glDisable(GL_BLEND);
+    // Only rasterise the cells whose centres can fall within the radius, the rest would add nothing
+    float cellSize = gridSpacing * GRID_SIZE / destination.width;
+    glm::ivec2 size = glm::ivec2(destination.width, destination.height);
+    glm::ivec2 lower = glm::clamp(glm::ivec2(glm::floor((position - radius) / cellSize)), glm::ivec2(0), size);
+    glm::ivec2 upper = glm::clamp(glm::ivec2(glm::ceil((position + radius) / cellSize)) + 1, glm::ivec2(0), size);
+    if (upper.x <= lower.x || upper.y <= lower.y) return;
+
+    glState.enableScissor(lower.x, lower.y, upper.x - lower.x, upper.y - lower.y);
+    drawFullscreenQuad(GL_SRC_ALPHA, GL_ONE);
+    glState.disableScissor();
 }
 
 void SmokeSimulation::applyBuoyancy(Surface temperatureSurface, Surface densitySurface, Surface velocityDestination) {
     GLuint program = applyBuoyancyProgram;
-    glUseProgram(program);
-
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint fallForceLocation = glGetUniformLocation(program, "fallForce");
-    GLint riseForceLocation = glGetUniformLocation(program, "riseForce");
-    GLint atmosphereTemperatureLocation = glGetUniformLocation(program, "atmosphereTemperature");
-    GLint gravityLocation = glGetUniformLocation(program, "gravity");
-    GLint densityTextureLocation = glGetUniformLocation(program, "densityTexture");
-
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(fallForceLocation, fallForce);
-    glUniform1f(riseForceLocation, riseForce);
-    glUniform1f(atmosphereTemperatureLocation, atmosphereTemperature);
-    glUniform1f(gravityLocation, gravity);
-    glUniform1i(densityTextureLocation, 1);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, velocityDestination.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, temperatureSurface.textureHandle);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, densitySurface.textureHandle);
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE);
-    drawFullscreenQuad();
-    glDisable(GL_BLEND);
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1f(locations.inverseSize, 1.0f / velocityDestination.width);
+    glUniform1f(locations.fallForce, fallForce * velocityStepScale());
+    glUniform1f(locations.riseForce, riseForce * velocityStepScale());
+    glUniform1f(locations.atmosphereTemperature, atmosphereTemperature);
+    glUniform1f(locations.gravity, gravity);
+    glUniform1i(locations.densityTexture, 1);
+
+    bindSurface(velocityDestination);
+    glState.bindTexture(0, temperatureSurface.textureHandle);
+    glState.bindTexture(1, densitySurface.textureHandle);
+
+    drawFullscreenQuad(GL_ONE, GL_ONE);
 }
 
 void SmokeSimulation::computeCurl(Surface velocitySurface, Surface curlSurface) {
     GLuint program = computeCurlProgram;
-    glUseProgram(program);
+    glState.useProgram(program);
 
-    GLint gridSizeLocation = glGetUniformLocation(program, "gridSize");
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint wrapBordersLocation = glGetUniformLocation(program, "wrapBorders");
-    GLint gridSpacingLocation = glGetUniformLocation(program, "gridSpacing");
+    UniformLocations &locations = locationsFor(program);
 
-    glUniform1i(gridSizeLocation, GRID_SIZE);
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(wrapBordersLocation, wrapBorders);
-    glUniform1f(gridSpacingLocation, gridSpacing);
+    glUniform1i(locations.gridSize, velocityGridSize);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, curlSurface.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, velocitySurface.textureHandle);
+    bindSurface(curlSurface);
+    glState.bindTexture(0, velocitySurface.textureHandle);
 
     drawFullscreenQuad();
 }
 
 void SmokeSimulation::applyVorticityConfinement(Surface curlSurface, Surface velocityDestination) {
     GLuint program = applyVorticityConfinementProgram;
-    glUseProgram(program);
-
-    GLint gridSizeLocation = glGetUniformLocation(program, "gridSize");
-    GLint inverseSizeLocation = glGetUniformLocation(program, "inverseSize");
-    GLint wrapBordersLocation = glGetUniformLocation(program, "wrapBorders");
-    GLint timeStepLocation = glGetUniformLocation(program, "timeStep");
-    GLint vorticityConfinementForceLocation = glGetUniformLocation(program, "vorticityConfinementForce");
-
-    glUniform1i(gridSizeLocation, GRID_SIZE);
-    glUniform1f(inverseSizeLocation, 1.0f / GRID_SIZE);
-    glUniform1f(wrapBordersLocation, wrapBorders);
-    glUniform1f(timeStepLocation, timeStep);
-    glUniform1f(vorticityConfinementForceLocation, vorticityConfinementForce);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, velocityDestination.fboHandle);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, curlSurface.textureHandle);
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE);
-    drawFullscreenQuad();
-    glDisable(GL_BLEND);
+    glState.useProgram(program);
+
+    UniformLocations &locations = locationsFor(program);
+
+    glUniform1i(locations.gridSize, velocityGridSize);
+    glUniform1f(locations.vorticityConfinementForce, vorticityConfinementForce);
+
+    bindSurface(velocityDestination);
+    glState.bindTexture(0, curlSurface.textureHandle);
+
+    drawFullscreenQuad(GL_ONE, GL_ONE);
 }
 
 void SmokeSimulation::renderGPU() {
-    GLuint gpuTextureA = 0;
-    GLuint gpuTextureB = 0;
+    glState.bindTexture(0, displayTextures[0]);
 
-    if (currentDisplay == COMPOSITION) {
-        gpuTextureA = dataForDisplayGPU(compositionFields[0]).ping.textureHandle;
-        gpuTextureB = dataForDisplayGPU(compositionFields[1]).ping.textureHandle;
-    } else {
-        gpuTextureA = dataForDisplayGPU(currentDisplay).ping.textureHandle;
+    glState.bindTexture(1, currentDisplay == COMPOSITION ? displayTextures[1] : 0);
+}
+
+void SmokeSimulation::interpolateDisplayFieldsGPU(float stepFraction) {
+    std::vector<Display> fields = currentDisplay == COMPOSITION ? compositionFields : std::vector<Display>{ currentDisplay };
+
+    for (size_t i = 0; i < 2 && i < fields.size(); i++) {
+        Surface field = dataForDisplayGPU(fields[i]).ping;
+        displayTextures[i] = field.textureHandle;
+
+        if (stepFraction <= 0.0f) continue;
+
+        // Only the advected scalar fields move with the flow, the MacCormack scratch is free between updates
+        Surface destination;
+        float dissipation;
+        switch (fields[i]) {
+            case DENSITY:
+                destination = i == 0 ? macCormackScalarSlab.ping : macCormackScalarSlab.pong;
+                dissipation = densityDissipation;
+                break;
+            case TEMPERATURE:
+                destination = i == 0 ? macCormackScalarSlab.ping : macCormackScalarSlab.pong;
+                dissipation = temperatureDissipation;
+                break;
+            case RGB:
+                // The rgb slabs are allocated lazily, there is no scratch to advect into until they exist
+                if (!rgbAllocated) continue;
+                destination = macCormackRgbSlab.ping;
+                dissipation = rgbDissipation;
+                break;
+            default:
+                continue;
+        }
+
+        // Advect along the current velocity for the part of a step the display is ahead by
+        bindSamplers();
+        updateFrameUniforms(stepFraction);
+        advect(velocitySlab.ping, field, destination, powf(dissipation, stepFraction));
+        displayTextures[i] = destination.textureHandle;
     }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gpuTextureA);
+    resetState();
+}
+
+void SmokeSimulation::upscaleDisplaySurface() {
+    glState.bindFramebuffer(defaultFramebuffer);
+    glState.viewport(framebufferWidth, framebufferHeight);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, gpuTextureB);
+    glState.useProgram(upscaleShader);
+    UniformLocations &locations = locationsFor(upscaleShader);
+
+    glUniform1i(locations.screenWidth, framebufferWidth);
+    glUniform1i(locations.screenHeight, framebufferHeight);
+    glUniform1i(locations.sourceTexture, 0);
+
+    glState.bindTexture(0, displaySurface.textureHandle);
+
+    drawFullscreenQuad();
 }
 
 SmokeSimulation::Slab SmokeSimulation::dataForDisplayGPU(Display display) {
@@ -465,8 +1316,9 @@ SmokeSimulation::Slab SmokeSimulation::dataForDisplayGPU(Display display) {
         case TEMPERATURE:
             return temperatureSlab;
         case CURL:
-            return curlSlab;
+            return Slab{ curlSurface, curlSurface };
         case RGB:
+            allocateRgbSlab();
             return rgbSlab;
         default:
             break;
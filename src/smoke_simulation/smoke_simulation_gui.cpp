@@ -13,6 +13,12 @@ void SmokeSimulationGui::render() {
     ImGui::Separator();
     renderDisplaySelector();
     ImGui::Separator();
+    renderResolutionSelector();
+    ImGui::Separator();
+    renderUpscalingSelector();
+    ImGui::Separator();
+    renderPrecisionSelector();
+    ImGui::Separator();
     renderVariables();
 
     ImGui::End();
@@ -26,11 +32,20 @@ void SmokeSimulationGui::renderToggles() {
     ImGui::Checkbox("Random Impulse Angle", &smokeSimulation->randomPulseAngle);
     ImGui::Checkbox("Enable Buoyancy Force", &smokeSimulation->enableBuoyancy);
     ImGui::Checkbox("Enable Vorticity Confinement", &smokeSimulation->enableVorticityConfinement);
+    ImGui::Checkbox("Enable Turbulence", &smokeSimulation->enableTurbulence);
+    ImGui::Checkbox("Enable Adaptive Resolution", &smokeSimulation->enableAdaptiveResolution);
+    ImGui::Checkbox("Enable Adaptive Substepping", &smokeSimulation->enableAdaptiveSubstepping);
+    ImGui::Checkbox("Enable MacCormack Advection", &smokeSimulation->enableMacCormack);
     ImGui::Checkbox("Wrap Borders", &smokeSimulation->wrapBorders);
     ImGui::Checkbox("Enable Pressure Solver", &smokeSimulation->enablePressureSolver);
+    ImGui::Checkbox("Multigrid Pressure Solver", &smokeSimulation->enableMultigrid);
+    ImGui::Checkbox("Packed Pressure Solver", &smokeSimulation->enablePackedSolver);
     ImGui::Checkbox("Compute Intermediate Fields", &smokeSimulation->computeIntermediateFields);
     ImGui::Checkbox("CPU Multithreading", &smokeSimulation->useCPUMultithreading);
     ImGui::Checkbox("GPU Implementation", &smokeSimulation->useGPUImplementation);
+    if (smokeSimulation->computeAvailable) {
+        ImGui::Checkbox("Compute Implementation", &smokeSimulation->useComputeImplementation);
+    }
 
     ImGui::Separator(); // Reset toggles
 
@@ -49,6 +64,66 @@ void SmokeSimulationGui::renderDisplaySelector() {
     if (ImGui::Button("Apply")) smokeSimulation->currentDisplay = SmokeSimulation::Display(displaySelect);
 }
 
+void SmokeSimulationGui::renderResolutionSelector() {
+    ImGui::Text("Velocity Grid Resolution");
+
+    SmokeSimulation::Resolution &resolution = smokeSimulation->velocityResolution;
+
+    if (ImGui::RadioButton("Full", resolution == SmokeSimulation::FULL)) resolution = SmokeSimulation::FULL;
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Half", resolution == SmokeSimulation::HALF)) resolution = SmokeSimulation::HALF;
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Quarter", resolution == SmokeSimulation::QUARTER)) resolution = SmokeSimulation::QUARTER;
+}
+
+void SmokeSimulationGui::renderUpscalingSelector() {
+    ImGui::Text("Display Upscaling");
+
+    SmokeSimulation::Upscaling &upscaling = smokeSimulation->upscaling;
+
+    if (ImGui::RadioButton("Bilinear", upscaling == SmokeSimulation::BILINEAR)) upscaling = SmokeSimulation::BILINEAR;
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Catmull-Rom", upscaling == SmokeSimulation::CATMULL_ROM)) upscaling = SmokeSimulation::CATMULL_ROM;
+}
+
+void SmokeSimulationGui::renderPrecisionSelector() {
+    if (ImGui::CollapsingHeader("Texture precision")) {
+        if (ImGui::Button("Standard")) smokeSimulation->usePrecisionPreset(SmokeSimulation::STANDARD_PRECISION);
+        ImGui::SameLine();
+        if (ImGui::Button("Bandwidth Saver")) smokeSimulation->usePrecisionPreset(SmokeSimulation::BANDWIDTH_SAVER);
+
+        // Signed fields need a float format, only the visual fields can drop further
+        SmokeSimulation::SlabPrecisions &precisions = smokeSimulation->precisions;
+        renderPrecisionOptions("Velocity", precisions.velocity, false, false);
+        renderPrecisionOptions("Density", precisions.density, true, false);
+        renderPrecisionOptions("Temperature", precisions.temperature, false, false);
+        renderPrecisionOptions("Curl", precisions.curl, false, false);
+        renderPrecisionOptions("Divergence", precisions.divergence, false, false);
+        renderPrecisionOptions("Pressure", precisions.pressure, false, false);
+        renderPrecisionOptions("RGB", precisions.rgb, true, true);
+    }
+}
+
+void SmokeSimulationGui::renderPrecisionOptions(const char *label, SmokeSimulation::Precision &precision, bool allowUnorm, bool allowPacked) {
+    ImGui::PushID(label);
+    ImGui::Text("%s", label);
+
+    ImGui::SameLine(100);
+    if (ImGui::RadioButton("32F", precision == SmokeSimulation::FLOAT32)) precision = SmokeSimulation::FLOAT32;
+    ImGui::SameLine();
+    if (ImGui::RadioButton("16F", precision == SmokeSimulation::FLOAT16)) precision = SmokeSimulation::FLOAT16;
+    if (allowPacked) {
+        ImGui::SameLine();
+        if (ImGui::RadioButton("11F", precision == SmokeSimulation::FLOAT11)) precision = SmokeSimulation::FLOAT11;
+    }
+    if (allowUnorm) {
+        ImGui::SameLine();
+        if (ImGui::RadioButton("8", precision == SmokeSimulation::UNORM8)) precision = SmokeSimulation::UNORM8;
+    }
+
+    ImGui::PopID();
+}
+
 void SmokeSimulationGui::renderVariables() {
 
     if (ImGui::CollapsingHeader("Core variables")) {
@@ -61,6 +136,26 @@ void SmokeSimulationGui::renderVariables() {
 
         ImGui::Text("Jacobi Iterations");
         ImGui::SliderInt("##jacobiIterations", &smokeSimulation->jacobiIterations, 0, 100, "%.0f");
+
+        ImGui::Text("Multigrid Cycles");
+        ImGui::SliderInt("##multigridCycles", &smokeSimulation->multigridCycles, 1, 8, "%.0f");
+
+        ImGui::Text("Smoothing Iterations");
+        ImGui::SliderInt("##smoothingIterations", &smokeSimulation->smoothingIterations, 1, 8, "%.0f");
+
+        ImGui::Text("Velocity Update Interval");
+        ImGui::SliderInt("##velocityUpdateInterval", &smokeSimulation->velocityUpdateInterval, 1, 8, "%.0f");
+    }
+
+    if (ImGui::CollapsingHeader("Substepping variables")) {
+
+        ImGui::Text("CFL Target");
+        ImGui::SliderFloat("##cflTarget", &smokeSimulation->cflTarget, 0.25f, 4.0f, "%.2f");
+
+        ImGui::Text("Max Trace Substeps");
+        ImGui::SliderInt("##maxTraceSubsteps", &smokeSimulation->maxTraceSubsteps, 1, 16, "%.0f");
+
+        ImGui::Text("Trace Substeps: %d", smokeSimulation->traceSubsteps);
     }
 
     if (ImGui::CollapsingHeader("Force Variables")) {
@@ -109,6 +204,24 @@ void SmokeSimulationGui::renderVariables() {
 
     }
 
+    if (ImGui::CollapsingHeader("Turbulence variables")) {
+
+        ImGui::Text("Turbulence Strength");
+        ImGui::SliderFloat("##turbulenceStrength", &smokeSimulation->turbulenceStrength, 0.0f, 2.0f, "%.2f");
+
+        ImGui::Text("Turbulence Scale");
+        ImGui::SliderFloat("##turbulenceScale", &smokeSimulation->turbulenceScale, 1.0f, 16.0f, "%.1f");
+    }
+
+    if (ImGui::CollapsingHeader("Adaptive resolution variables")) {
+
+        ImGui::Text("Refinement Threshold");
+        ImGui::SliderFloat("##refinementThreshold", &smokeSimulation->refinementThreshold, 0.001f, 0.1f, "%.3f");
+    }
+
+    ImGui::Text("Velocity Glyph Stride");
+    ImGui::SliderInt("##glyphStride", &smokeSimulation->glyphStride, 1, 32);
+
     // ImGui::Text("Stroke Weight");
     // ImGui::SliderFloat("##O", &smokeSimulation->strokeWeight, 0.1f, 10.0f, "%.2f");
 
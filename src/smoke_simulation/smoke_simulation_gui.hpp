@@ -24,6 +24,10 @@ private:
     // Rendering
     void renderToggles();
     void renderDisplaySelector();
+    void renderResolutionSelector();
+    void renderUpscalingSelector();
+    void renderPrecisionSelector();
+    void renderPrecisionOptions(const char *label, SmokeSimulation::Precision &precision, bool allowUnorm, bool allowPacked);
     void renderVariables();
 
 };